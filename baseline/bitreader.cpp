@@ -1,47 +1,169 @@
 #include "bitreader.h"
 
-#include <iostream>
+#include <algorithm>
+#include <stdexcept>
 
-BitReader::BitReader(std::istream& input) : input_(input) {
-    // Read1Byte();
+namespace {
+
+constexpr int kEof = std::istream::traits_type::eof();
+
+bool IsRestartMarker(int byte) {
+    return 0xD0 <= byte && byte <= 0xD7;
+}
+
+}  // namespace
+
+BitReader::BitReader(std::istream& input) : input_(&input) {
+}
+
+BitReader::BitReader(std::span<const uint8_t> data)
+    : data_(data.data()), data_end_(data.data() + data.size()) {
+}
+
+int BitReader::GetByte() {
+    if (input_) {
+        return input_->get();
+    }
+    return data_ == data_end_ ? kEof : *data_++;
+}
+
+int BitReader::PeekByte() {
+    if (input_) {
+        return input_->peek();
+    }
+    return data_ == data_end_ ? kEof : *data_;
+}
+
+void BitReader::UngetByte() {
+    if (input_) {
+        input_->unget();
+    } else {
+        --data_;
+    }
 }
 
 uint8_t BitReader::Read1Byte() {
-    buf_ = input_.get();
+    buf_ = GetByte();
     return buf_;
 }
 
-void BitReader::ReadSos() {
-    while (true) {
-        uint8_t byte = input_.get();
+void BitReader::SkipBytes(size_t count) {
+    if (input_) {
+        input_->ignore(count);
+    } else {
+        data_ += std::min<size_t>(count, data_end_ - data_);
+    }
+}
+
+void BitReader::Refill() {
+    while (bits_count_ <= 56 && !marker_reached_) {
+        int byte = GetByte();
+        if (byte == kEof) {
+            marker_reached_ = true;
+            break;
+        }
         if (byte == 0xFF) {
-            if (input_.peek() != 0x00) {
-                input_.unget();
+            if (PeekByte() != 0x00) {
+                UngetByte();
+                marker_reached_ = true;
                 break;
             }
-            input_.get();
+            GetByte();
         }
-        for (int b = 7; b >= 0; --b) {
-            if ((byte >> b) & 1) {
-                buffer_sos_.emplace_back(1);
-            } else {
-                buffer_sos_.emplace_back(0);
-            }
+        bits_ |= static_cast<uint64_t>(byte) << (56 - bits_count_);
+        bits_count_ += 8;
+    }
+}
+
+bool BitReader::NextBit() {
+    return GetBits(1);
+}
+
+uint32_t BitReader::PeekBits(size_t count) {
+    if (bits_count_ < count) {
+        Refill();
+    }
+    if (count == 0) {
+        return 0;
+    }
+    return bits_ >> (64 - count);
+}
+
+void BitReader::SkipBits(size_t count) {
+    if (bits_count_ < count) {
+        Refill();
+        if (bits_count_ < count) {
+            throw std::out_of_range("SOS buffer out of range");
         }
     }
+    bits_ <<= count;
+    bits_count_ -= count;
+}
+
+uint32_t BitReader::GetBits(size_t count) {
+    uint32_t bits = PeekBits(count);
+    SkipBits(count);
+    return bits;
 }
 
-bool BitReader::GetBit(size_t idx) {
-    if (idx >= buffer_sos_.size()) {
-        throw std::out_of_range("SOS buffer out of range");
+void BitReader::FinishSos() {
+    while (!marker_reached_) {
+        bits_count_ = 0;
+        Refill();
     }
-    return buffer_sos_[idx];
+    bits_ = 0;
+    bits_count_ = 0;
+    marker_reached_ = false;
 }
 
-bool BitReader::NextBit() {
-    return GetBit(idx_++);
+std::span<const uint8_t> BitReader::ReadSegment() {
+    if (!input_) {
+        const uint8_t* begin = data_;
+        for (; data_ != data_end_; ++data_) {
+            if (*data_ == 0xFF &&
+                (data_ + 1 == data_end_ || (data_[1] != 0x00 && !IsRestartMarker(data_[1])))) {
+                break;
+            }
+        }
+        return {begin, data_};
+    }
+    segment_.clear();
+    while (true) {
+        int byte = GetByte();
+        if (byte == kEof) {
+            break;
+        }
+        if (byte == 0xFF) {
+            int next = PeekByte();
+            if (next != 0x00 && !IsRestartMarker(next)) {
+                UngetByte();
+                break;
+            }
+            segment_.push_back(byte);
+            byte = GetByte();
+        }
+        segment_.push_back(byte);
+    }
+    return segment_;
 }
 
-size_t BitReader::GetIndex() {
-    return idx_;
+void BitReader::SkipSegment() {
+    if (!input_) {
+        ReadSegment();
+        return;
+    }
+    while (true) {
+        int byte = GetByte();
+        if (byte == kEof) {
+            break;
+        }
+        if (byte == 0xFF) {
+            int next = PeekByte();
+            if (next != 0x00 && !IsRestartMarker(next)) {
+                UngetByte();
+                break;
+            }
+            GetByte();
+        }
+    }
 }
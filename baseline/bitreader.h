@@ -1,28 +1,60 @@
 #pragma once
 
 #include <istream>
-#include <vector>
 #include <cstdint>
+#include <span>
+#include <vector>
 
 class BitReader {
 public:
     BitReader(std::istream& input);
 
+    // Reads straight from memory, which must outlive the reader. Past the end
+    // of |data| bytes read as EOF and entropy-coded data stops as at a marker.
+    BitReader(std::span<const uint8_t> data);
+
     uint8_t Read1Byte();
-    void ReadSos();
+    // Skips |count| bytes, or to the end of the data.
+    void SkipBytes(size_t count);
 
-    bool GetBit(size_t idx);
+    // Entropy-coded data is read through a 64-bit buffer which is refilled
+    // from the source a byte at a time, skipping stuffed zero bytes after
+    // 0xFF. Refilling stops at the first marker; bits past it read as zeros,
+    // but consuming them throws.
     bool NextBit();
 
-    size_t GetIndex();
+    // Returns the next |count| (at most 32) bits without consuming them, the
+    // first one in the most significant position.
+    uint32_t PeekBits(size_t count);
+    void SkipBits(size_t count);
+    uint32_t GetBits(size_t count);
 
-    bool flag_ = 0;
-    int cnt = 0;
+    // Drops buffered bits and skips the rest of the entropy-coded segment, so
+    // that the source is positioned at the marker which ends it.
+    void FinishSos();
+
+    // Returns the raw bytes of the rest of the entropy-coded segment, with
+    // byte stuffing and restart markers kept in place, and stops before the
+    // first other marker. In memory they are not copied; otherwise they are
+    // valid until the next call.
+    std::span<const uint8_t> ReadSegment();
+
+    // Skips the same bytes as ReadSegment without keeping them.
+    void SkipSegment();
 
 private:
-    std::istream& input_;
+    int GetByte();
+    int PeekByte();
+    void UngetByte();
+    void Refill();
+
+    std::istream* input_ = nullptr;
+    const uint8_t* data_ = nullptr;
+    const uint8_t* data_end_ = nullptr;
     uint8_t buf_ = 0;
-    int pos_ = 7;
-    std::vector<bool> buffer_sos_;
-    size_t idx_ = 0;
-};
\ No newline at end of file
+    // Buffered bits, aligned to the most significant end.
+    uint64_t bits_ = 0;
+    size_t bits_count_ = 0;
+    bool marker_reached_ = false;
+    std::vector<uint8_t> segment_;
+};
@@ -0,0 +1,31 @@
+#include "color.h"
+
+namespace {
+
+ColorKernel SelectColorKernel() {
+#ifdef DECODER_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return YCbCrToRgbRowAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return YCbCrToRgbRowSse2;
+    }
+#endif
+    return YCbCrToRgbRow;
+}
+
+}  // namespace
+
+void YCbCrToRgbRow(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, uint8_t* output,
+                   size_t width, PixelFormat format) {
+    size_t bytes_per_pixel = Image::BytesPerPixel(format);
+    for (size_t x = 0; x < width; ++x) {
+        YCbCrToRgbPixel(y[x], cb[x], cr[x], output + x * bytes_per_pixel, format);
+    }
+}
+
+ColorKernel DefaultColorKernel() {
+    static const ColorKernel kKernel = SelectColorKernel();
+    return kKernel;
+}
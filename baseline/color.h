@@ -0,0 +1,55 @@
+#pragma once
+
+#include <image.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// Converts |width| pixels of full-resolution Y, Cb and Cr samples into packed
+// |format| pixels (kRGB888, kRGBA8888 or kBGRA8888) at |output|.
+using ColorKernel = void (*)(const uint8_t* y, const uint8_t* cb, const uint8_t* cr,
+                             uint8_t* output, size_t width, PixelFormat format);
+
+// JFIF conversion constants with 16 fractional bits, rounded like libjpeg
+// rounds them, so that the output matches it exactly.
+constexpr int kColorBits = 16;
+constexpr int kColorHalf = 1 << (kColorBits - 1);
+constexpr int kFixCrToR = 91881;   // 1.402
+constexpr int kFixCbToG = 22554;   // 0.34414
+constexpr int kFixCrToG = 46802;   // 0.71414
+constexpr int kFixCbToB = 116130;  // 1.772
+
+inline void YCbCrToRgbPixel(int y, int cb, int cr, uint8_t* pixel, PixelFormat format) {
+    cb -= 128;
+    cr -= 128;
+    int r = std::clamp(y + ((kFixCrToR * cr + kColorHalf) >> kColorBits), 0, 255);
+    int g = std::clamp(y + ((-kFixCbToG * cb - kFixCrToG * cr + kColorHalf) >> kColorBits), 0,
+                       255);
+    int b = std::clamp(y + ((kFixCbToB * cb + kColorHalf) >> kColorBits), 0, 255);
+    if (format == PixelFormat::kBGRA8888) {
+        std::swap(r, b);
+    }
+    pixel[0] = r;
+    pixel[1] = g;
+    pixel[2] = b;
+    if (format != PixelFormat::kRGB888) {
+        pixel[3] = 255;
+    }
+}
+
+void YCbCrToRgbRow(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, uint8_t* output,
+                   size_t width, PixelFormat format);
+
+#ifdef DECODER_X86_SIMD
+// Vector versions of YCbCrToRgbRow with identical output, in their own
+// translation units like the IDCT kernels.
+void YCbCrToRgbRowSse2(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, uint8_t* output,
+                       size_t width, PixelFormat format);
+void YCbCrToRgbRowAvx2(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, uint8_t* output,
+                       size_t width, PixelFormat format);
+#endif
+
+// The fastest converter supported by the CPU, detected on first use.
+ColorKernel DefaultColorKernel();
@@ -0,0 +1,94 @@
+#include "color.h"
+
+#include <emmintrin.h>
+
+namespace {
+
+// The constants do not fit into 16 bits, so their integer parts are applied
+// as additions and only the fractions go through _mm_madd_epi16, on pairs
+// of (Cb, Cr):
+//   R = Y + Cr + (0.402 Cr)
+//   G = Y - Cr + (-0.34414 Cb + 0.28586 Cr)
+//   B = Y + 2 Cb + (-0.228 Cb)
+// Rounding and shifting the fractions alone gives the same result as with
+// the whole constants, since the integer parts are multiples of 1 << 16.
+constexpr int kFracCrToR = kFixCrToR - (1 << kColorBits);
+constexpr int kFracCrToG = (1 << kColorBits) - kFixCrToG;
+constexpr int kFracCbToB = kFixCbToB - (2 << kColorBits);
+
+__m128i Pairs(int cb_factor, int cr_factor) {
+    return _mm_setr_epi16(cb_factor, cr_factor, cb_factor, cr_factor, cb_factor, cr_factor,
+                          cb_factor, cr_factor);
+}
+
+__m128i Fraction(__m128i lo, __m128i hi, __m128i factors) {
+    __m128i half = _mm_set1_epi32(kColorHalf);
+    lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(lo, factors), half), kColorBits);
+    hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(hi, factors), half), kColorBits);
+    return _mm_packs_epi32(lo, hi);
+}
+
+// Converts eight pixels of 16-bit samples, Cb and Cr already centered.
+void Convert(__m128i y, __m128i cb, __m128i cr, __m128i& r, __m128i& g, __m128i& b) {
+    __m128i lo = _mm_unpacklo_epi16(cb, cr);
+    __m128i hi = _mm_unpackhi_epi16(cb, cr);
+    r = _mm_add_epi16(_mm_add_epi16(y, cr), Fraction(lo, hi, Pairs(0, kFracCrToR)));
+    g = _mm_add_epi16(_mm_sub_epi16(y, cr), Fraction(lo, hi, Pairs(-kFixCbToG, kFracCrToG)));
+    b = _mm_add_epi16(_mm_add_epi16(y, _mm_add_epi16(cb, cb)),
+                      Fraction(lo, hi, Pairs(kFracCbToB, 0)));
+}
+
+}  // namespace
+
+void YCbCrToRgbRowSse2(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, uint8_t* output,
+                       size_t width, PixelFormat format) {
+    size_t bytes_per_pixel = Image::BytesPerPixel(format);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i center = _mm_set1_epi16(128);
+    const __m128i alpha = _mm_set1_epi8(-1);
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x));
+        __m128i cb8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cb + x));
+        __m128i cr8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cr + x));
+        __m128i r[2], g[2], b[2];
+        Convert(_mm_unpacklo_epi8(y8, zero), _mm_sub_epi16(_mm_unpacklo_epi8(cb8, zero), center),
+                _mm_sub_epi16(_mm_unpacklo_epi8(cr8, zero), center), r[0], g[0], b[0]);
+        Convert(_mm_unpackhi_epi8(y8, zero), _mm_sub_epi16(_mm_unpackhi_epi8(cb8, zero), center),
+                _mm_sub_epi16(_mm_unpackhi_epi8(cr8, zero), center), r[1], g[1], b[1]);
+        __m128i first = _mm_packus_epi16(r[0], r[1]);
+        __m128i second = _mm_packus_epi16(g[0], g[1]);
+        __m128i third = _mm_packus_epi16(b[0], b[1]);
+        if (format == PixelFormat::kBGRA8888) {
+            std::swap(first, third);
+        }
+
+        __m128i pairs_lo = _mm_unpacklo_epi8(first, second);
+        __m128i pairs_hi = _mm_unpackhi_epi8(first, second);
+        __m128i rest_lo = _mm_unpacklo_epi8(third, alpha);
+        __m128i rest_hi = _mm_unpackhi_epi8(third, alpha);
+        __m128i pixels[4] = {
+            _mm_unpacklo_epi16(pairs_lo, rest_lo), _mm_unpackhi_epi16(pairs_lo, rest_lo),
+            _mm_unpacklo_epi16(pairs_hi, rest_hi), _mm_unpackhi_epi16(pairs_hi, rest_hi)};
+        uint8_t* out = output + x * bytes_per_pixel;
+        if (format != PixelFormat::kRGB888) {
+            for (size_t k = 0; k < 4; ++k) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * k), pixels[k]);
+            }
+            continue;
+        }
+        // SSE2 has no byte shuffle to drop the alpha bytes in registers.
+        alignas(16) uint8_t packed[64];
+        for (size_t k = 0; k < 4; ++k) {
+            _mm_store_si128(reinterpret_cast<__m128i*>(packed + 16 * k), pixels[k]);
+        }
+        for (size_t k = 0; k < 16; ++k) {
+            out[3 * k] = packed[4 * k];
+            out[3 * k + 1] = packed[4 * k + 1];
+            out[3 * k + 2] = packed[4 * k + 2];
+        }
+    }
+    for (; x < width; ++x) {
+        YCbCrToRgbPixel(y[x], cb[x], cr[x], output + x * bytes_per_pixel, format);
+    }
+}
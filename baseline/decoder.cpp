@@ -1,8 +1,78 @@
 #include <decoder.h>
+#include <decoder_context.h>
 #include <glog/logging.h>
+#include "mapped_file.h"
 #include "reader.h"
+#include "thread_pool.h"
 
-Image Decode(std::istream& input) {
-    Reader reader(input);
+#include <algorithm>
+#include <atomic>
+
+Image Decode(std::istream& input, const DecoderOptions& options) {
+    Reader reader(input, options);
+    return reader.DecodeImage();
+}
+
+Image Decode(std::span<const uint8_t> data, const DecoderOptions& options) {
+    Reader reader(data, options);
     return reader.DecodeImage();
 }
+
+Image DecodeRegion(std::istream& input, const Region& region, const DecoderOptions& options) {
+    Reader reader(input, options);
+    return reader.DecodeRegion(region);
+}
+
+Image DecodeRegion(std::span<const uint8_t> data, const Region& region,
+                   const DecoderOptions& options) {
+    Reader reader(data, options);
+    return reader.DecodeRegion(region);
+}
+
+ImageHeader ProbeHeader(std::istream& input) {
+    Reader reader(input);
+    return reader.ProbeHeader();
+}
+
+ImageHeader ProbeHeader(std::span<const uint8_t> data) {
+    Reader reader(data);
+    return reader.ProbeHeader();
+}
+
+ImageHeader DecodeRows(std::istream& input, const RowSink& sink, const DecoderOptions& options) {
+    Reader reader(input, options);
+    return reader.DecodeRows(sink);
+}
+
+ImageHeader DecodeRows(std::span<const uint8_t> data, const RowSink& sink,
+                       const DecoderOptions& options) {
+    Reader reader(data, options);
+    return reader.DecodeRows(sink);
+}
+
+std::vector<BatchItem> DecodeBatch(const std::vector<std::span<const uint8_t>>& inputs,
+                                   const DecoderOptions& options) {
+    std::vector<BatchItem> items(inputs.size());
+    DecoderOptions item_options = options;
+    item_options.threads = 1;
+    ThreadPool pool(options.threads);
+    // One task per thread, each with a context of its own, takes the next
+    // image until there are none left.
+    std::atomic<size_t> next = 0;
+    pool.ParallelFor(std::min(pool.Size(), inputs.size()), [&](size_t) {
+        DecoderContext context(item_options);
+        for (size_t i = next++; i < inputs.size(); i = next++) {
+            try {
+                items[i].image = context.Decode(inputs[i]);
+            } catch (...) {
+                items[i].error = std::current_exception();
+            }
+        }
+    });
+    return items;
+}
+
+Image DecodeFile(const std::string& path, const DecoderOptions& options) {
+    MappedFile file(path);
+    return Decode(file.Data(), options);
+}
@@ -0,0 +1,19 @@
+#include <decoder_context.h>
+
+#include "reader.h"
+
+DecoderContext::DecoderContext(const DecoderOptions& options)
+    : reader_(std::make_unique<Reader>(options)) {
+}
+
+DecoderContext::~DecoderContext() = default;
+
+Image DecoderContext::Decode(std::istream& input) {
+    reader_->Reset(input);
+    return reader_->DecodeImage();
+}
+
+Image DecoderContext::Decode(std::span<const uint8_t> data) {
+    reader_->Reset(data);
+    return reader_->DecodeImage();
+}
@@ -1,6 +1,98 @@
 #include <cmath>
 #include <fft.h>
+#include <fft_plans.h>
 #include <fftw3.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <tuple>
+
+namespace {
+
+// Planning in FFTW is not thread-safe, executing a plan on new arrays is, so
+// only the lookup and creation of plans happen under the lock.
+class PlanCache {
+public:
+    static PlanCache &Instance() {
+        static PlanCache cache;
+        return cache;
+    }
+
+    PlanCache(const PlanCache &) = delete;
+    PlanCache &operator=(const PlanCache &) = delete;
+
+    ~PlanCache() {
+        for (auto &[key, plan] : plans_) {
+            fftw_destroy_plan(plan);
+        }
+    }
+
+    // Returns a plan which may be executed with fftw_execute_r2r on |input|
+    // and |output|.
+    fftw_plan Get(size_t width, double *input, double *output) {
+        bool in_place = input == output;
+        int input_alignment = fftw_alignment_of(input);
+        int output_alignment = fftw_alignment_of(output);
+        std::lock_guard lock(mutex_);
+        Key key{width, input_alignment, output_alignment, in_place, flags_};
+        if (auto it = plans_.find(key); it != plans_.end()) {
+            return it->second;
+        }
+
+        // Measuring overwrites the arrays, so plan on scratch memory with the
+        // same alignment instead of the caller's data.
+        size_t size = width * width + 2;
+        double *scratch_input = fftw_alloc_real(size);
+        double *scratch_output = in_place ? scratch_input : fftw_alloc_real(size);
+        fftw_plan plan = fftw_plan_r2r_2d(
+            width, width, scratch_input + input_alignment / sizeof(double),
+            scratch_output + output_alignment / sizeof(double), FFTW_REDFT01, FFTW_REDFT01, flags_);
+        if (!in_place) {
+            fftw_free(scratch_output);
+        }
+        fftw_free(scratch_input);
+        if (plan == nullptr) {
+            throw std::runtime_error("Can't create FFTW plan");
+        }
+        plans_.emplace(key, plan);
+        return plan;
+    }
+
+    void SetFlags(unsigned flags) {
+        std::lock_guard lock(mutex_);
+        flags_ = flags;
+        generation_.fetch_add(1, std::memory_order_release);
+    }
+
+    // Changes whenever the flags do, so that plans taken earlier can be
+    // checked without the lock.
+    unsigned Generation() const {
+        return generation_.load(std::memory_order_acquire);
+    }
+
+    bool ImportWisdom(const std::string &filename) {
+        std::lock_guard lock(mutex_);
+        return fftw_import_wisdom_from_filename(filename.c_str());
+    }
+
+    bool ExportWisdom(const std::string &filename) {
+        std::lock_guard lock(mutex_);
+        return fftw_export_wisdom_to_filename(filename.c_str());
+    }
+
+private:
+    using Key = std::tuple<size_t, int, int, bool, unsigned>;
+
+    PlanCache() = default;
+
+    std::mutex mutex_;
+    std::map<Key, fftw_plan> plans_;
+    unsigned flags_ = FFTW_ESTIMATE;
+    std::atomic<unsigned> generation_ = 0;
+};
+
+}  // namespace
 
 class DctCalculator::Impl {
 public:
@@ -13,10 +105,7 @@ public:
             input->data()[i] *= kSq2;
             input->data()[i * width] *= kSq2;
         }
-        fftw_plan plan = fftw_plan_r2r_2d(width, width, input->data(), output->data(), FFTW_REDFT01,
-                                          FFTW_REDFT01, FFTW_ESTIMATE);
-        fftw_execute(plan);
-        fftw_destroy_plan(plan);
+        fftw_execute_r2r(Plan(), input->data(), output->data());
         for (auto &el : *output) {
             el /= 16;
         }
@@ -26,6 +115,36 @@ public:
     size_t width;
     std::vector<double> *input;
     std::vector<double> *output;
+
+private:
+    // The plan is taken from the cache once and kept while the arrays stay
+    // where they were, or move to the same alignment, and the flags stay the
+    // same; the cache lock is not taken for every block.
+    fftw_plan Plan() {
+        double *input_data = input->data();
+        double *output_data = output->data();
+        if (input_data != input_data_ || output_data != output_data_) {
+            if (plan_ && (fftw_alignment_of(input_data) != fftw_alignment_of(input_data_) ||
+                          fftw_alignment_of(output_data) != fftw_alignment_of(output_data_) ||
+                          (input_data == output_data) != (input_data_ == output_data_))) {
+                plan_ = nullptr;
+            }
+            input_data_ = input_data;
+            output_data_ = output_data;
+        }
+        PlanCache &cache = PlanCache::Instance();
+        unsigned generation = cache.Generation();
+        if (!plan_ || generation != generation_) {
+            plan_ = cache.Get(width, input_data, output_data);
+            generation_ = generation;
+        }
+        return plan_;
+    }
+
+    fftw_plan plan_ = nullptr;
+    double *input_data_ = nullptr;
+    double *output_data_ = nullptr;
+    unsigned generation_ = 0;
 };
 
 DctCalculator::DctCalculator(size_t width, std::vector<double> *input,
@@ -44,3 +163,15 @@ void DctCalculator::Inverse() {
 }
 
 DctCalculator::~DctCalculator() = default;
+
+void SetMeasureFftwPlans(bool measure) {
+    PlanCache::Instance().SetFlags(measure ? FFTW_MEASURE : FFTW_ESTIMATE);
+}
+
+bool ImportFftwWisdom(const std::string &filename) {
+    return PlanCache::Instance().ImportWisdom(filename);
+}
+
+bool ExportFftwWisdom(const std::string &filename) {
+    return PlanCache::Instance().ExportWisdom(filename);
+}
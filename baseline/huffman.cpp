@@ -1,110 +1,147 @@
 #include <huffman.h>
-#include <queue>
+#include <array>
+#include <stdexcept>
 
 class HuffmanTree::Impl {
-    struct Node {
+    static constexpr size_t kMaxLength = 16;
+    static constexpr size_t kLookupSize = 1 << kLookupBits;
+
+    struct LookupEntry {
+        uint8_t length = 0;
         uint8_t value = 0;
-        bool terminal = false;
-        std::shared_ptr<Node> left;
-        std::shared_ptr<Node> right;
+    };
+
+    struct CoefficientEntry {
+        // Code and magnitude bits together, 0 if they do not fit.
+        uint8_t length = 0;
+        uint8_t value = 0;
+        int16_t coefficient = 0;
     };
 
 public:
     Impl() {
-        root = std::make_shared<Node>();
-        vertex = root;
+        Reset();
     }
 
     void Build(const std::vector<uint8_t> &code_lengths, const std::vector<uint8_t> &values) {
-        if (code_lengths.size() > 16) {
+        if (code_lengths.size() > kMaxLength) {
             throw std::invalid_argument("Huffman too big");
         }
-        if (root != nullptr) {
-            Delete(root);
-            root.reset();
-            root = std::make_shared<Node>();
-            vertex = root;
-        }
-        size_t max_depth = 0;
-        for (size_t i = 0; i < code_lengths.size(); ++i) {
-            if (code_lengths[i]) {
-                max_depth = i + 1;
-            }
-        }
+        Reset();
+
+        // Codes are canonical: consecutive within a length, and the first code
+        // of the next length is the successor of the last one shifted left.
+        int code = 0;
         size_t ptr_values = 0;
-        // size_t ptr_depth = 0;
-        // size_t depth = 0;
-        std::queue<std::pair<std::shared_ptr<Node>, size_t>> q;
-        q.emplace(root, 0);
-        std::vector<uint8_t> code_lengths_done(code_lengths.size(), 0);
-
-        while (!q.empty()) {
-            auto [v, d] = q.front();
-            q.pop();
-            if (d > 0 && code_lengths_done[d - 1] < code_lengths[d - 1]) {
-                if (ptr_values == values.size()) {
+        for (size_t len = 1; len <= code_lengths.size(); ++len) {
+            size_t count = code_lengths[len - 1];
+            if (count) {
+                max_depth = len;
+                if (ptr_values + count > values.size()) {
                     throw std::invalid_argument("No value to store");
                 }
-                v->value = values[ptr_values++];
-                v->terminal = true;
-                ++code_lengths_done[d - 1];
-                continue;
-            }
-            if (d + 1 > max_depth) {
-                continue;
-            }
-            if (v->left == nullptr) {
-                v->left = std::make_shared<Node>();
-            }
-            q.emplace(v->left, d + 1);
-            if (v->right == nullptr) {
-                v->right = std::make_shared<Node>();
+                if (code + count > (1u << len)) {
+                    throw std::invalid_argument("Too much vertices");
+                }
+                min_code[len] = code;
+                max_code[len] = code + count - 1;
+                value_ptr[len] = ptr_values;
+                for (size_t k = 0; k < count; ++k, ++code) {
+                    symbols.push_back(values[ptr_values + k]);
+                    if (len <= kLookupBits) {
+                        size_t shift = kLookupBits - len;
+                        for (size_t idx = code << shift; idx < (code + 1u) << shift; ++idx) {
+                            lookup[idx] = {static_cast<uint8_t>(len), values[ptr_values + k]};
+                        }
+                    }
+                }
+                ptr_values += count;
             }
-            q.emplace(v->right, d + 1);
+            code <<= 1;
         }
-        for (size_t i = 0; i < code_lengths.size(); ++i) {
-            if (code_lengths_done[i] < code_lengths[i]) {
-                throw std::invalid_argument("Too much vertices");
+        BuildCoefficients();
+    }
+
+    void BuildCoefficients() {
+        for (size_t idx = 0; idx < kLookupSize; ++idx) {
+            const LookupEntry &entry = lookup[idx];
+            size_t magnitude_length = entry.value & 0x0F;
+            size_t length = entry.length + magnitude_length;
+            if (!entry.length || length > kLookupBits) {
+                continue;
             }
+            int bits = (idx >> (kLookupBits - length)) & ((1 << magnitude_length) - 1);
+            coefficients[idx] = {static_cast<uint8_t>(length), entry.value,
+                                 static_cast<int16_t>(Extend(bits, magnitude_length))};
         }
     }
 
     bool Move(bool bit, int &value) {
-        if (!bit) {
-            if (vertex->left == nullptr) {
-                throw std::invalid_argument("Can't move");
-            }
-            vertex = vertex->left;
-            if (vertex->terminal) {
-                value = vertex->value;
-                vertex = root;
-                return true;
-            }
-        } else {
-            if (vertex->right == nullptr) {
-                throw std::invalid_argument("Can't move");
-            }
-            vertex = vertex->right;
-            if (vertex->terminal) {
-                value = vertex->value;
-                vertex = root;
-                return true;
-            }
+        code_ = (code_ << 1) | bit;
+        ++length_;
+        if (length_ > max_depth) {
+            code_ = 0;
+            length_ = 0;
+            throw std::invalid_argument("Can't move");
+        }
+        if (code_ <= max_code[length_]) {
+            value = symbols[value_ptr[length_] + code_ - min_code[length_]];
+            code_ = 0;
+            length_ = 0;
+            return true;
         }
         return false;
     }
 
-    void Delete(std::shared_ptr<Node> v) {
-        if (v == nullptr) {
-            return;
+    size_t Decode(uint16_t bits, int &value) const {
+        const LookupEntry &entry = lookup[bits >> (kMaxLength - kLookupBits)];
+        if (entry.length) {
+            value = entry.value;
+            return entry.length;
         }
-        Delete(v->left);
-        Delete(v->right);
-        v.reset();
+        for (size_t len = kLookupBits + 1; len <= max_depth; ++len) {
+            int code = bits >> (kMaxLength - len);
+            if (code <= max_code[len]) {
+                value = symbols[value_ptr[len] + code - min_code[len]];
+                return len;
+            }
+        }
+        throw std::invalid_argument("Invalid huffman code");
     }
 
-    std::shared_ptr<Node> root;
-    std::shared_ptr<Node> vertex;
+    size_t DecodeCoefficient(uint16_t bits, int &value, int &coefficient) const {
+        const CoefficientEntry &entry = coefficients[bits >> (kMaxLength - kLookupBits)];
+        if (entry.length) {
+            value = entry.value;
+            coefficient = entry.coefficient;
+        }
+        return entry.length;
+    }
+
+    void Reset() {
+        max_depth = 0;
+        min_code.fill(0);
+        max_code.fill(-1);
+        value_ptr.fill(0);
+        lookup.fill({});
+        coefficients.fill({});
+        symbols.clear();
+        code_ = 0;
+        length_ = 0;
+    }
+
+    size_t max_depth;
+    std::array<int, kMaxLength + 1> min_code;
+    // -1 for lengths without codes, so that no code compares below it.
+    std::array<int, kMaxLength + 1> max_code;
+    std::array<size_t, kMaxLength + 1> value_ptr;
+    std::array<LookupEntry, kLookupSize> lookup;
+    std::array<CoefficientEntry, kLookupSize> coefficients;
+    std::vector<uint8_t> symbols;
+
+    // Partial code accumulated by Move.
+    int code_;
+    size_t length_;
 };
 
 HuffmanTree::HuffmanTree() {
@@ -120,6 +157,14 @@ bool HuffmanTree::Move(bool bit, int &value) {
     return impl_->Move(bit, value);
 }
 
+size_t HuffmanTree::Decode(uint16_t bits, int &value) const {
+    return impl_->Decode(bits, value);
+}
+
+size_t HuffmanTree::DecodeCoefficient(uint16_t bits, int &value, int &coefficient) const {
+    return impl_->DecodeCoefficient(bits, value, coefficient);
+}
+
 HuffmanTree::HuffmanTree(HuffmanTree &&) = default;
 
 HuffmanTree &HuffmanTree::operator=(HuffmanTree &&) = default;
@@ -0,0 +1,175 @@
+#include "idct.h"
+#include "idct_butterfly.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+uint8_t ClampSample(int64_t value) {
+    return std::clamp<int64_t>(value + 128, 0, 255);
+}
+
+// Half of the cosines of the reduced transforms, scaled by 2^kConstBits.
+constexpr int64_t kFix0191341716 = 1567;
+constexpr int64_t kFix0353553391 = 2896;
+constexpr int64_t kFix0461939766 = 3784;
+
+// One-dimensional N-point inverse transforms of v[0..N-1] in place, results
+// descaled by |bits|. Normalized like the 8-point one, so that a constant
+// block keeps its level.
+void InverseReduced(int64_t (&v)[4], int bits) {
+    int64_t even0 = (v[0] + v[2]) * kFix0353553391;
+    int64_t even1 = (v[0] - v[2]) * kFix0353553391;
+    int64_t odd0 = v[1] * kFix0461939766 + v[3] * kFix0191341716;
+    int64_t odd1 = v[1] * kFix0191341716 - v[3] * kFix0461939766;
+    v[0] = Descale(even0 + odd0, bits);
+    v[1] = Descale(even1 + odd1, bits);
+    v[2] = Descale(even1 - odd1, bits);
+    v[3] = Descale(even0 - odd0, bits);
+}
+
+void InverseReduced(int64_t (&v)[2], int bits) {
+    int64_t sum = (v[0] + v[1]) * kFix0353553391;
+    int64_t difference = (v[0] - v[1]) * kFix0353553391;
+    v[0] = Descale(sum, bits);
+    v[1] = Descale(difference, bits);
+}
+
+template <size_t N>
+void InverseDctReduced(const int16_t* coefficients, const uint16_t* quant, uint8_t* output,
+                       size_t stride) {
+    int64_t workspace[N * N];
+    int64_t v[N];
+    for (size_t x = 0; x < N; ++x) {
+        for (size_t y = 0; y < N; ++y) {
+            v[y] = int64_t{coefficients[y * 8 + x]} * quant[y * 8 + x];
+        }
+        InverseReduced(v, kConstBits - kPass1Bits);
+        for (size_t y = 0; y < N; ++y) {
+            workspace[y * N + x] = v[y];
+        }
+    }
+    for (size_t y = 0; y < N; ++y) {
+        std::copy(workspace + y * N, workspace + y * N + N, v);
+        InverseReduced(v, kConstBits + kPass1Bits);
+        for (size_t x = 0; x < N; ++x) {
+            output[y * stride + x] = ClampSample(v[x]);
+        }
+    }
+}
+
+IdctKernel SelectIdctKernel() {
+#ifdef DECODER_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return InverseDctAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return InverseDctSse2;
+    }
+#endif
+    return InverseDctInteger;
+}
+
+}  // namespace
+
+void InverseDctInteger(const int16_t* coefficients, const uint16_t* quant, uint8_t* output,
+                       size_t stride) {
+    // Columns. Most of them have no AC terms, which makes them constant.
+    int64_t workspace[64];
+    int64_t v[8];
+    for (size_t x = 0; x < 8; ++x) {
+        const int16_t* in = coefficients + x;
+        const uint16_t* q = quant + x;
+        if (!in[8] && !in[16] && !in[24] && !in[32] && !in[40] && !in[48] && !in[56]) {
+            for (size_t y = 0; y < 8; ++y) {
+                workspace[y * 8 + x] = (int64_t{in[0]} * q[0]) << kPass1Bits;
+            }
+            continue;
+        }
+        for (size_t y = 0; y < 8; ++y) {
+            v[y] = int64_t{in[y * 8]} * q[y * 8];
+        }
+        InverseButterfly(v, kConstBits - kPass1Bits);
+        for (size_t y = 0; y < 8; ++y) {
+            workspace[y * 8 + x] = v[y];
+        }
+    }
+
+    // Rows, removing the pass 1 scaling and the factor of 8 of the transform.
+    for (size_t y = 0; y < 8; ++y) {
+        std::copy(workspace + y * 8, workspace + y * 8 + 8, v);
+        InverseButterfly(v, kPass2Bits);
+        uint8_t* out = output + y * stride;
+        for (size_t x = 0; x < 8; ++x) {
+            out[x] = ClampSample(v[x]);
+        }
+    }
+}
+
+IdctKernel DefaultIdctKernel() {
+    static const IdctKernel kKernel = SelectIdctKernel();
+    return kKernel;
+}
+
+void InverseDct4x4(const int16_t* coefficients, const uint16_t* quant, uint8_t* output,
+                   size_t stride) {
+    InverseDctReduced<4>(coefficients, quant, output, stride);
+}
+
+void InverseDct2x2(const int16_t* coefficients, const uint16_t* quant, uint8_t* output,
+                   size_t stride) {
+    InverseDctReduced<2>(coefficients, quant, output, stride);
+}
+
+// Only the DC term is left: the mean of the block.
+void InverseDct1x1(const int16_t* coefficients, const uint16_t* quant, uint8_t* output, size_t) {
+    output[0] = ClampSample(Descale(int64_t{coefficients[0]} * quant[0], 3));
+}
+
+InverseDct::InverseDct(IdctMethod method) : method_(method), kernel_(DefaultIdctKernel()) {
+    if (method_ == IdctMethod::kFftw) {
+        input_.resize(64);
+        output_.resize(64);
+        calculator_.emplace(8, &input_, &output_);
+    }
+}
+
+void InverseDct::Transform(const int16_t* coefficients, const uint16_t* quant, uint8_t* output,
+                           size_t stride, size_t block_size) {
+    switch (block_size) {
+        case 8:
+            if (method_ == IdctMethod::kFftw) {
+                TransformFftw(coefficients, quant, output, stride);
+            } else {
+                kernel_(coefficients, quant, output, stride);
+            }
+            break;
+        case 4:
+            InverseDct4x4(coefficients, quant, output, stride);
+            break;
+        case 2:
+            InverseDct2x2(coefficients, quant, output, stride);
+            break;
+        case 1:
+            InverseDct1x1(coefficients, quant, output, stride);
+            break;
+        default:
+            throw std::invalid_argument("Unsupported IDCT block size");
+    }
+}
+
+void InverseDct::TransformFftw(const int16_t* coefficients, const uint16_t* quant,
+                               uint8_t* output, size_t stride) {
+    for (size_t i = 0; i < 64; ++i) {
+        input_[i] = coefficients[i] * quant[i];
+    }
+    calculator_->Inverse();
+    for (size_t y = 0; y < 8; ++y) {
+        for (size_t x = 0; x < 8; ++x) {
+            output[y * stride + x] = ClampSample(std::lround(output_[y * 8 + x]));
+        }
+    }
+}
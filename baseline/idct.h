@@ -0,0 +1,63 @@
+#pragma once
+
+#include <decoder.h>
+#include <fft.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Dequantizes the 8x8 |coefficients| with |quant| (both in natural order),
+// applies the inverse DCT and writes level-shifted samples clamped to
+// [0, 255] into |output|, |stride| bytes per row.
+using IdctKernel = void (*)(const int16_t* coefficients, const uint16_t* quant, uint8_t* output,
+                            size_t stride);
+
+void InverseDctInteger(const int16_t* coefficients, const uint16_t* quant, uint8_t* output,
+                       size_t stride);
+
+#ifdef DECODER_X86_SIMD
+// Vector versions of InverseDctInteger producing identical samples for valid
+// streams. Each lives in its own translation unit built for its instruction
+// set and must only be called on CPUs supporting it.
+void InverseDctSse2(const int16_t* coefficients, const uint16_t* quant, uint8_t* output,
+                    size_t stride);
+void InverseDctAvx2(const int16_t* coefficients, const uint16_t* quant, uint8_t* output,
+                    size_t stride);
+#endif
+
+// The fastest integer kernel supported by the CPU, detected on first use.
+IdctKernel DefaultIdctKernel();
+
+// Reduced transforms for decoding at 1/2, 1/4 and 1/8 scale. Only the
+// top-left N x N coefficients are used, and the N x N samples written
+// approximate the 8x8 block downscaled by 8 / N.
+void InverseDct4x4(const int16_t* coefficients, const uint16_t* quant, uint8_t* output,
+                   size_t stride);
+void InverseDct2x2(const int16_t* coefficients, const uint16_t* quant, uint8_t* output,
+                   size_t stride);
+void InverseDct1x1(const int16_t* coefficients, const uint16_t* quant, uint8_t* output,
+                   size_t stride);
+
+// Per-scan inverse DCT engine for the method selected in DecoderOptions.
+class InverseDct {
+public:
+    explicit InverseDct(IdctMethod method);
+
+    // |block_size| is the side of the output block: 8, or 4, 2 and 1 for the
+    // reduced transforms, which are always computed in fixed point.
+    void Transform(const int16_t* coefficients, const uint16_t* quant, uint8_t* output,
+                   size_t stride, size_t block_size = 8);
+
+private:
+    void TransformFftw(const int16_t* coefficients, const uint16_t* quant, uint8_t* output,
+                       size_t stride);
+
+    IdctMethod method_;
+    IdctKernel kernel_;
+    // Only made for IdctMethod::kFftw.
+    std::vector<double> input_;
+    std::vector<double> output_;
+    std::optional<DctCalculator> calculator_;
+};
@@ -0,0 +1,88 @@
+#include "idct.h"
+#include "idct_butterfly.h"
+
+#include <immintrin.h>
+
+namespace {
+
+// Eight 32-bit lanes, one per column (first pass) or row (second pass).
+struct Lanes {
+    __m256i v;
+};
+
+Lanes operator+(Lanes a, Lanes b) {
+    return {_mm256_add_epi32(a.v, b.v)};
+}
+
+Lanes operator-(Lanes a, Lanes b) {
+    return {_mm256_sub_epi32(a.v, b.v)};
+}
+
+Lanes operator*(Lanes a, int64_t c) {
+    return {_mm256_mullo_epi32(a.v, _mm256_set1_epi32(c))};
+}
+
+Lanes operator<<(Lanes a, int bits) {
+    return {_mm256_slli_epi32(a.v, bits)};
+}
+
+Lanes Descale(Lanes a, int bits) {
+    return {_mm256_srai_epi32(_mm256_add_epi32(a.v, _mm256_set1_epi32(1 << (bits - 1))), bits)};
+}
+
+void Transpose(Lanes (&r)[8]) {
+    __m256i t0 = _mm256_unpacklo_epi32(r[0].v, r[1].v);
+    __m256i t1 = _mm256_unpackhi_epi32(r[0].v, r[1].v);
+    __m256i t2 = _mm256_unpacklo_epi32(r[2].v, r[3].v);
+    __m256i t3 = _mm256_unpackhi_epi32(r[2].v, r[3].v);
+    __m256i t4 = _mm256_unpacklo_epi32(r[4].v, r[5].v);
+    __m256i t5 = _mm256_unpackhi_epi32(r[4].v, r[5].v);
+    __m256i t6 = _mm256_unpacklo_epi32(r[6].v, r[7].v);
+    __m256i t7 = _mm256_unpackhi_epi32(r[6].v, r[7].v);
+
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+    __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+    __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+    r[0].v = _mm256_permute2x128_si256(u0, u4, 0x20);
+    r[1].v = _mm256_permute2x128_si256(u1, u5, 0x20);
+    r[2].v = _mm256_permute2x128_si256(u2, u6, 0x20);
+    r[3].v = _mm256_permute2x128_si256(u3, u7, 0x20);
+    r[4].v = _mm256_permute2x128_si256(u0, u4, 0x31);
+    r[5].v = _mm256_permute2x128_si256(u1, u5, 0x31);
+    r[6].v = _mm256_permute2x128_si256(u2, u6, 0x31);
+    r[7].v = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+}  // namespace
+
+void InverseDctAvx2(const int16_t* coefficients, const uint16_t* quant, uint8_t* output,
+                    size_t stride) {
+    Lanes rows[8];
+    for (size_t y = 0; y < 8; ++y) {
+        __m256i c = _mm256_cvtepi16_epi32(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(coefficients + y * 8)));
+        __m256i q = _mm256_cvtepu16_epi32(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(quant + y * 8)));
+        rows[y].v = _mm256_mullo_epi32(c, q);
+    }
+
+    InverseButterfly(rows, kConstBits - kPass1Bits);
+    Transpose(rows);
+    InverseButterfly(rows, kPass2Bits);
+    Transpose(rows);
+
+    // Saturating packs clamp the same way as the scalar kernel.
+    const __m128i offset = _mm_set1_epi16(128);
+    for (size_t y = 0; y < 8; ++y) {
+        __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(rows[y].v),
+                                        _mm256_extracti128_si256(rows[y].v, 1));
+        __m128i bytes = _mm_packus_epi16(_mm_adds_epi16(words, offset), words);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(output + y * stride), bytes);
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+
+// Everything here has internal linkage on purpose: the header is compiled
+// into translation units built for different instruction sets, and sharing
+// one inline definition between them could leak AVX2 code into the scalar
+// path.
+namespace {
+
+// Islow-style LLM transform: constants are scaled by 2^kConstBits, and the
+// intermediate results between the passes keep kPass1Bits of fraction.
+constexpr int kConstBits = 13;
+constexpr int kPass1Bits = 2;
+constexpr int kPass2Bits = kConstBits + kPass1Bits + 3;
+
+constexpr int64_t kFix0298631336 = 2446;
+constexpr int64_t kFix0390180644 = 3196;
+constexpr int64_t kFix0541196100 = 4433;
+constexpr int64_t kFix0765366865 = 6270;
+constexpr int64_t kFix0899976223 = 7373;
+constexpr int64_t kFix1175875602 = 9633;
+constexpr int64_t kFix1501321110 = 12299;
+constexpr int64_t kFix1847759065 = 15137;
+constexpr int64_t kFix1961570560 = 16069;
+constexpr int64_t kFix2053119869 = 16819;
+constexpr int64_t kFix2562915447 = 20995;
+constexpr int64_t kFix3072711026 = 25172;
+
+inline int64_t Descale(int64_t value, int bits) {
+    return (value + (int64_t{1} << (bits - 1))) >> bits;
+}
+
+// One-dimensional 8-point inverse transform of v[0..7] in place, results
+// descaled by |bits|. V is either a scalar or a vector of independent lanes
+// with +, -, multiplication by a constant, << and Descale.
+template <class V>
+void InverseButterfly(V (&v)[8], int bits) {
+    // Even part.
+    V z2 = v[2];
+    V z3 = v[6];
+    V z1 = (z2 + z3) * kFix0541196100;
+    V tmp2 = z1 + z3 * -kFix1847759065;
+    V tmp3 = z1 + z2 * kFix0765366865;
+
+    V tmp0 = (v[0] + v[4]) << kConstBits;
+    V tmp1 = (v[0] - v[4]) << kConstBits;
+
+    V tmp10 = tmp0 + tmp3;
+    V tmp13 = tmp0 - tmp3;
+    V tmp11 = tmp1 + tmp2;
+    V tmp12 = tmp1 - tmp2;
+
+    // Odd part.
+    tmp0 = v[7];
+    tmp1 = v[5];
+    tmp2 = v[3];
+    tmp3 = v[1];
+
+    z1 = tmp0 + tmp3;
+    z2 = tmp1 + tmp2;
+    z3 = tmp0 + tmp2;
+    V z4 = tmp1 + tmp3;
+    V z5 = (z3 + z4) * kFix1175875602;
+
+    tmp0 = tmp0 * kFix0298631336;
+    tmp1 = tmp1 * kFix2053119869;
+    tmp2 = tmp2 * kFix3072711026;
+    tmp3 = tmp3 * kFix1501321110;
+    z1 = z1 * -kFix0899976223;
+    z2 = z2 * -kFix2562915447;
+    z3 = z3 * -kFix1961570560 + z5;
+    z4 = z4 * -kFix0390180644 + z5;
+
+    tmp0 = tmp0 + z1 + z3;
+    tmp1 = tmp1 + z2 + z4;
+    tmp2 = tmp2 + z2 + z3;
+    tmp3 = tmp3 + z1 + z4;
+
+    v[0] = Descale(tmp10 + tmp3, bits);
+    v[7] = Descale(tmp10 - tmp3, bits);
+    v[1] = Descale(tmp11 + tmp2, bits);
+    v[6] = Descale(tmp11 - tmp2, bits);
+    v[2] = Descale(tmp12 + tmp1, bits);
+    v[5] = Descale(tmp12 - tmp1, bits);
+    v[3] = Descale(tmp13 + tmp0, bits);
+    v[4] = Descale(tmp13 - tmp0, bits);
+}
+
+}  // namespace
@@ -0,0 +1,130 @@
+#include "idct.h"
+#include "idct_butterfly.h"
+
+#include <emmintrin.h>
+
+namespace {
+
+// SSE2 has no 32-bit multiply, so the transform works on 16-bit samples and
+// gets 32-bit products from _mm_madd_epi16 on interleaved pairs of inputs.
+// The butterflies of InverseButterfly are expanded into sums of such
+// products; integer arithmetic is exact, so the results do not change as
+// long as the inputs fit into 16 bits, which they do for valid streams.
+
+__m128i Madd(__m128i pairs, int64_t first, int64_t second) {
+    return _mm_madd_epi16(pairs, _mm_setr_epi16(first, second, first, second, first, second,
+                                                first, second));
+}
+
+__m128i Descale(__m128i value, int bits) {
+    return _mm_srai_epi32(_mm_add_epi32(value, _mm_set1_epi32(1 << (bits - 1))), bits);
+}
+
+// Transforms four lanes given as interleaved pairs of inputs (v0, v4),
+// (v2, v6), (v7, v5) and (v3, v1).
+void Butterfly(__m128i p04, __m128i p26, __m128i p75, __m128i p31, int bits, __m128i (&out)[8]) {
+    constexpr int64_t kOne = int64_t{1} << kConstBits;
+
+    // Even part.
+    __m128i tmp0 = Madd(p04, kOne, kOne);
+    __m128i tmp1 = Madd(p04, kOne, -kOne);
+    __m128i tmp2 = Madd(p26, kFix0541196100, kFix0541196100 - kFix1847759065);
+    __m128i tmp3 = Madd(p26, kFix0541196100 + kFix0765366865, kFix0541196100);
+
+    __m128i tmp10 = _mm_add_epi32(tmp0, tmp3);
+    __m128i tmp13 = _mm_sub_epi32(tmp0, tmp3);
+    __m128i tmp11 = _mm_add_epi32(tmp1, tmp2);
+    __m128i tmp12 = _mm_sub_epi32(tmp1, tmp2);
+
+    // Odd part, with z1..z5 distributed over v7, v5, v3 and v1.
+    tmp0 = _mm_add_epi32(
+        Madd(p75, kFix0298631336 - kFix0899976223 + kFix1175875602 - kFix1961570560,
+             kFix1175875602),
+        Madd(p31, kFix1175875602 - kFix1961570560, kFix1175875602 - kFix0899976223));
+    tmp1 = _mm_add_epi32(
+        Madd(p75, kFix1175875602,
+             kFix2053119869 - kFix2562915447 + kFix1175875602 - kFix0390180644),
+        Madd(p31, kFix1175875602 - kFix2562915447, kFix1175875602 - kFix0390180644));
+    tmp2 = _mm_add_epi32(
+        Madd(p75, kFix1175875602 - kFix1961570560, kFix1175875602 - kFix2562915447),
+        Madd(p31, kFix3072711026 - kFix2562915447 + kFix1175875602 - kFix1961570560,
+             kFix1175875602));
+    tmp3 = _mm_add_epi32(
+        Madd(p75, kFix1175875602 - kFix0899976223, kFix1175875602 - kFix0390180644),
+        Madd(p31, kFix1175875602,
+             kFix1501321110 - kFix0899976223 + kFix1175875602 - kFix0390180644));
+
+    out[0] = Descale(_mm_add_epi32(tmp10, tmp3), bits);
+    out[7] = Descale(_mm_sub_epi32(tmp10, tmp3), bits);
+    out[1] = Descale(_mm_add_epi32(tmp11, tmp2), bits);
+    out[6] = Descale(_mm_sub_epi32(tmp11, tmp2), bits);
+    out[2] = Descale(_mm_add_epi32(tmp12, tmp1), bits);
+    out[5] = Descale(_mm_sub_epi32(tmp12, tmp1), bits);
+    out[3] = Descale(_mm_add_epi32(tmp13, tmp0), bits);
+    out[4] = Descale(_mm_sub_epi32(tmp13, tmp0), bits);
+}
+
+// Transforms all eight lanes of 16-bit |v| in place.
+void Pass(__m128i (&v)[8], int bits) {
+    __m128i lo[8];
+    __m128i hi[8];
+    Butterfly(_mm_unpacklo_epi16(v[0], v[4]), _mm_unpacklo_epi16(v[2], v[6]),
+              _mm_unpacklo_epi16(v[7], v[5]), _mm_unpacklo_epi16(v[3], v[1]), bits, lo);
+    Butterfly(_mm_unpackhi_epi16(v[0], v[4]), _mm_unpackhi_epi16(v[2], v[6]),
+              _mm_unpackhi_epi16(v[7], v[5]), _mm_unpackhi_epi16(v[3], v[1]), bits, hi);
+    for (size_t i = 0; i < 8; ++i) {
+        v[i] = _mm_packs_epi32(lo[i], hi[i]);
+    }
+}
+
+void Transpose(__m128i (&r)[8]) {
+    __m128i a0 = _mm_unpacklo_epi16(r[0], r[1]);
+    __m128i a1 = _mm_unpackhi_epi16(r[0], r[1]);
+    __m128i a2 = _mm_unpacklo_epi16(r[2], r[3]);
+    __m128i a3 = _mm_unpackhi_epi16(r[2], r[3]);
+    __m128i a4 = _mm_unpacklo_epi16(r[4], r[5]);
+    __m128i a5 = _mm_unpackhi_epi16(r[4], r[5]);
+    __m128i a6 = _mm_unpacklo_epi16(r[6], r[7]);
+    __m128i a7 = _mm_unpackhi_epi16(r[6], r[7]);
+
+    __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+    __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+    __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+    __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+    __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+    __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+    __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+    __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+
+    r[0] = _mm_unpacklo_epi64(b0, b4);
+    r[1] = _mm_unpackhi_epi64(b0, b4);
+    r[2] = _mm_unpacklo_epi64(b1, b5);
+    r[3] = _mm_unpackhi_epi64(b1, b5);
+    r[4] = _mm_unpacklo_epi64(b2, b6);
+    r[5] = _mm_unpackhi_epi64(b2, b6);
+    r[6] = _mm_unpacklo_epi64(b3, b7);
+    r[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+}  // namespace
+
+void InverseDctSse2(const int16_t* coefficients, const uint16_t* quant, uint8_t* output,
+                    size_t stride) {
+    __m128i rows[8];
+    for (size_t y = 0; y < 8; ++y) {
+        rows[y] = _mm_mullo_epi16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(coefficients + y * 8)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(quant + y * 8)));
+    }
+
+    Pass(rows, kConstBits - kPass1Bits);
+    Transpose(rows);
+    Pass(rows, kPass2Bits);
+    Transpose(rows);
+
+    const __m128i offset = _mm_set1_epi16(128);
+    for (size_t y = 0; y < 8; ++y) {
+        __m128i bytes = _mm_packus_epi16(_mm_adds_epi16(rows[y], offset), rows[y]);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(output + y * stride), bytes);
+    }
+}
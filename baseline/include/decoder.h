@@ -3,6 +3,124 @@
 #pragma once
 
 #include <image.h>
+#include <cstdint>
+#include <exception>
+#include <functional>
 #include <istream>
+#include <span>
+#include <string>
+#include <vector>
 
-Image Decode(std::istream& input);
+enum class IdctMethod {
+    // Fixed-point separable 8x8 transform (LLM butterflies).
+    kInteger,
+    // Floating-point transform through FFTW, the accuracy reference.
+    kFftw,
+};
+
+enum class Upsampling {
+    // Triangle filters of libjpeg for 2x horizontal and vertical subsampling, giving the
+    // same pixels as libjpeg does by default.
+    kFancy,
+    // Replicates every chroma sample over the pixels it covers.
+    kBox,
+};
+
+struct DecoderOptions {
+    IdctMethod idct = IdctMethod::kInteger;
+    // Layout of the decoded image. kGray8 keeps only the luma of color images,
+    // kYCbCrSubsampled the samples of every component as they are, without upsampling or
+    // color conversion.
+    PixelFormat format = PixelFormat::kRGB888;
+    // Threads a decoder works on, 0 for all hardware threads. With more than one, baseline
+    // images with restart markers have their intervals decoded in parallel, those without
+    // have the IDCT and color conversion of every MCU row overlap the entropy decoding of
+    // the next rows, and progressive images have their MCU rows transformed in parallel
+    // after the last scan. DecodeBatch decodes that many images at a time instead, each on
+    // one thread. 1 decodes sequentially on the calling thread, as does decoding into a
+    // RowSink.
+    size_t threads = 1;
+    // The image is decoded scaled down by 1, 2, 4 or 8 (rounding sizes up),
+    // with reduced inverse transforms instead of downsampling afterwards.
+    size_t scale = 1;
+    // How subsampled chroma is brought to the resolution of the image.
+    Upsampling upsampling = Upsampling::kFancy;
+    // Called for progressive images after every scan but the last with a preview rendered
+    // from the coefficients decoded so far, and the number of scans read. Returning false
+    // stops decoding, and the preview is returned as the image.
+    std::function<bool(const Image& preview, size_t scans)> progressive_preview = nullptr;
+};
+
+struct ComponentHeader {
+    size_t id;
+    size_t h_sampling;
+    size_t v_sampling;
+    size_t quant_table;
+};
+
+// What the markers before the scan tell about the image.
+struct ImageHeader {
+    size_t width = 0;
+    size_t height = 0;
+    std::vector<ComponentHeader> components;
+    // MCUs per restart interval, 0 without restart markers.
+    size_t restart_interval = 0;
+    // SOF2: the coefficients come in several scans of increasing precision.
+    bool progressive = false;
+    std::string comment;
+};
+
+// Rectangle of the decoded image in pixels, after scaling.
+struct Region {
+    size_t x = 0;
+    size_t y = 0;
+    size_t width = 0;
+    size_t height = 0;
+};
+
+Image Decode(std::istream& input, const DecoderOptions& options = {});
+
+// Decodes an image held in memory without copying it.
+Image Decode(std::span<const uint8_t> data, const DecoderOptions& options = {});
+
+// Decodes only |region| of the image, clipped to it. MCUs before the region
+// are entropy decoded to keep DC prediction right, or skipped with restart
+// intervals, but nothing outside it is transformed or converted.
+Image DecodeRegion(std::istream& input, const Region& region, const DecoderOptions& options = {});
+Image DecodeRegion(std::span<const uint8_t> data, const Region& region,
+                   const DecoderOptions& options = {});
+
+// Parses the markers up to the first scan, without reading any entropy-coded
+// data or allocating the image.
+ImageHeader ProbeHeader(std::istream& input);
+ImageHeader ProbeHeader(std::span<const uint8_t> data);
+
+// Receives |rows|, the rows of the image from |y| on, at most one MCU row of them. The
+// buffer is reused for the next rows. Planes of kYCbCrSubsampled rows hold the samples
+// of that MCU row, which follow the rows of the plane received before.
+using RowSink = std::function<void(const Image& rows, size_t y)>;
+
+// Decodes the image into |sink| top to bottom, keeping only one MCU row of samples and
+// pixels instead of the whole image (progressive images still keep their coefficients).
+// Rows are produced in order, so this decodes on the calling thread only. Returns what
+// the markers tell about the image, the comment included.
+ImageHeader DecodeRows(std::istream& input, const RowSink& sink,
+                       const DecoderOptions& options = {});
+ImageHeader DecodeRows(std::span<const uint8_t> data, const RowSink& sink,
+                       const DecoderOptions& options = {});
+
+// Outcome of decoding one image of a batch: the image, or what decoding threw.
+struct BatchItem {
+    Image image;
+    std::exception_ptr error;
+};
+
+// Decodes every input on options.threads threads (0 for all hardware threads), each image
+// on a single thread. Every thread decodes through a DecoderContext of its own and takes
+// the next image when done, so big ones do not hold up the rest. The results are in the
+// order of |inputs|.
+std::vector<BatchItem> DecodeBatch(const std::vector<std::span<const uint8_t>>& inputs,
+                                   const DecoderOptions& options = {});
+
+// Maps the file at |path| into memory and decodes it in place.
+Image DecodeFile(const std::string& path, const DecoderOptions& options = {});
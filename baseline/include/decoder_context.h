@@ -0,0 +1,30 @@
+#pragma once
+
+#include <decoder.h>
+#include <image.h>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <span>
+
+class Reader;
+
+// Decodes image after image with the same options, keeping the storage of the
+// tables, the sample and coefficient buffers and the threads of the previous
+// image for the next one. Worth it for many small images, where setting up a
+// decoder costs as much as decoding. Not thread-safe, use one per thread.
+class DecoderContext {
+public:
+    explicit DecoderContext(const DecoderOptions& options = {});
+
+    DecoderContext(const DecoderContext&) = delete;
+    DecoderContext& operator=(const DecoderContext&) = delete;
+
+    ~DecoderContext();
+
+    Image Decode(std::istream& input);
+    Image Decode(std::span<const uint8_t> data);
+
+private:
+    std::unique_ptr<Reader> reader_;
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+// FFTW plans are shared by all DctCalculators in the process and created once
+// per width and data alignment. They are estimated by default; after
+// SetMeasureFftwPlans(true) new plans are measured instead, which is slow to
+// plan but faster to execute.
+void SetMeasureFftwPlans(bool measure);
+
+// Load and store FFTW wisdom, so that measured plans survive restarts.
+// Return false on failure.
+bool ImportFftwWisdom(const std::string& filename);
+bool ExportFftwWisdom(const std::string& filename);
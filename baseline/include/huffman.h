@@ -29,6 +29,31 @@ public:
     // and value is unmodified.
     bool Move(bool bit, int& value);
 
+    // Number of leading bits resolved by a single table lookup in Decode.
+    static constexpr size_t kLookupBits = 9;
+
+    // Decodes the symbol whose code starts at the most significant bit of
+    // |bits| (the next 16 bits of the stream) and writes it to |value|.
+    // Returns the length of the code. Codes not longer than kLookupBits take
+    // one table lookup, longer ones fall back to the canonical code ranges.
+    // Does not touch the state used by Move.
+    size_t Decode(uint16_t bits, int& value) const;
+
+    // Decodes a run/size symbol together with the magnitude bits following
+    // it. If the code and the number of magnitude bits given by the low
+    // nibble of the symbol together fit into kLookupBits, writes the symbol to
+    // |value|, the sign-extended coefficient to |coefficient| and returns the
+    // total number of bits. Otherwise returns 0 and leaves both unmodified.
+    size_t DecodeCoefficient(uint16_t bits, int& value, int& coefficient) const;
+
+    // Converts |length| magnitude bits |bits| into a signed coefficient.
+    static int Extend(int bits, size_t length) {
+        if (length == 0) {
+            return 0;
+        }
+        return bits < (1 << (length - 1)) ? bits - (1 << length) + 1 : bits;
+    }
+
     ~HuffmanTree();
 
 private:
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <decoder.h>
+#include <image.h>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+// Decodes an image while its data is still arriving. Chunks passed to Feed are
+// decoded as far as they go on a thread of the decoder's own, which waits for
+// the next chunk whenever the data runs out, mid-segment or mid-MCU alike, and
+// resumes right where it stopped.
+//
+// Every decoder thus holds an OS thread, started by the constructor and mostly
+// blocked waiting for data, until Finish or destruction; without a sink and
+// with options.threads other than 1 it also runs a thread pool of its own.
+// Thousands of uploads in flight mean as many parked threads, so servers
+// taking many at once should cap the number of live decoders, or buffer the
+// uploads and decode them whole with a DecoderContext or DecodeBatch.
+class PushDecoder {
+public:
+    explicit PushDecoder(const DecoderOptions& options = {});
+    // Passes the rows to |sink| as soon as they are decoded instead of keeping
+    // the image, see DecodeRows. The sink is called on the decoding thread, not
+    // the one calling Feed, concurrently with it, so whatever it touches that
+    // the caller also does needs synchronization. It is done with when Finish
+    // returns.
+    PushDecoder(const RowSink& sink, const DecoderOptions& options = {});
+
+    PushDecoder(const PushDecoder&) = delete;
+    PushDecoder& operator=(const PushDecoder&) = delete;
+
+    // Abandons the decoding if Finish was not called.
+    ~PushDecoder();
+
+    // Copies |chunk|, the next bytes of the image, and returns without waiting
+    // for them to be decoded. Bytes fed once decoding has ended are dropped.
+    void Feed(std::span<const uint8_t> chunk);
+
+    // Marks the end of the data and waits for the decoding to end. Returns the
+    // image, only with its comment when decoding into a sink, and rethrows
+    // what decoding threw.
+    Image Finish();
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
@@ -0,0 +1,148 @@
+#include <push_decoder.h>
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <istream>
+#include <mutex>
+#include <stdexcept>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Stream buffer over the fed chunks. The decoding thread waits in underflow()
+// until the next chunk arrives or the data is finished. The last byte of the
+// previous chunk is kept in front of the current one, since the bit reader
+// puts back a byte after peeking past a 0xFF.
+class ChunkBuffer : public std::streambuf {
+public:
+    void Feed(std::span<const uint8_t> chunk) {
+        std::lock_guard lock(mutex_);
+        if (finished_) {
+            throw std::logic_error("Data fed after Finish");
+        }
+        if (closed_ || chunk.empty()) {
+            return;
+        }
+        pending_.emplace_back(chunk.begin(), chunk.end());
+        arrived_.notify_one();
+    }
+
+    void Finish() {
+        std::lock_guard lock(mutex_);
+        finished_ = true;
+        arrived_.notify_one();
+    }
+
+    // Called once decoding has ended: whatever comes next is not needed.
+    void Close() {
+        std::lock_guard lock(mutex_);
+        closed_ = true;
+        pending_.clear();
+    }
+
+protected:
+    int_type underflow() override {
+        std::vector<uint8_t> chunk;
+        {
+            std::unique_lock lock(mutex_);
+            arrived_.wait(lock, [&] { return !pending_.empty() || finished_; });
+            if (pending_.empty()) {
+                return traits_type::eof();
+            }
+            chunk = std::move(pending_.front());
+            pending_.pop_front();
+        }
+        size_t putback = 0;
+        if (!current_.empty()) {
+            chunk.insert(chunk.begin(), current_.back());
+            putback = 1;
+        }
+        current_ = std::move(chunk);
+        char* begin = reinterpret_cast<char*>(current_.data());
+        setg(begin, begin + putback, begin + current_.size());
+        return traits_type::to_int_type(*gptr());
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable arrived_;
+    std::deque<std::vector<uint8_t>> pending_;
+    bool finished_ = false;
+    bool closed_ = false;
+    std::vector<uint8_t> current_;
+};
+
+}  // namespace
+
+class PushDecoder::Impl {
+public:
+    Impl(const RowSink* sink, const DecoderOptions& options) {
+        if (sink) {
+            sink_ = *sink;
+        }
+        thread_ = std::thread([this, options] {
+            try {
+                if (sink_) {
+                    image_.SetComment(DecodeRows(input_, sink_, options).comment);
+                } else {
+                    image_ = Decode(input_, options);
+                }
+            } catch (...) {
+                error_ = std::current_exception();
+            }
+            buffer_.Close();
+        });
+    }
+
+    ~Impl() {
+        if (thread_.joinable()) {
+            buffer_.Finish();
+            thread_.join();
+        }
+    }
+
+    void Feed(std::span<const uint8_t> chunk) {
+        buffer_.Feed(chunk);
+    }
+
+    Image Finish() {
+        if (!thread_.joinable()) {
+            throw std::logic_error("Finish called twice");
+        }
+        buffer_.Finish();
+        thread_.join();
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+        return std::move(image_);
+    }
+
+private:
+    ChunkBuffer buffer_;
+    std::istream input_{&buffer_};
+    RowSink sink_;
+    Image image_;
+    std::exception_ptr error_;
+    std::thread thread_;
+};
+
+PushDecoder::PushDecoder(const DecoderOptions& options)
+    : impl_(std::make_unique<Impl>(nullptr, options)) {
+}
+
+PushDecoder::PushDecoder(const RowSink& sink, const DecoderOptions& options)
+    : impl_(std::make_unique<Impl>(&sink, options)) {
+}
+
+PushDecoder::~PushDecoder() = default;
+
+void PushDecoder::Feed(std::span<const uint8_t> chunk) {
+    impl_->Feed(chunk);
+}
+
+Image PushDecoder::Finish() {
+    return impl_->Finish();
+}
@@ -1,14 +1,70 @@
 #include "reader.h"
+#include "color.h"
+#include "upsample.h"
 
 #include <string>
 #include <cmath>
-#include <fft.h>
 #include <iostream>
 #include <valarray>
+#include <condition_variable>
+#include <mutex>
+#include <numeric>
+#include <algorithm>
 
 // #define uint16_t uint16_t
 
-Reader::Reader(std::istream& input) : bit_reader_(input) {
+Reader::Reader(std::istream& input, const DecoderOptions& options)
+    : bit_reader_(input), options_(options) {
+    CheckOptions();
+}
+
+Reader::Reader(std::span<const uint8_t> data, const DecoderOptions& options)
+    : bit_reader_(data), options_(options) {
+    CheckOptions();
+}
+
+Reader::Reader(const DecoderOptions& options)
+    : bit_reader_(std::span<const uint8_t>()), options_(options) {
+    CheckOptions();
+}
+
+void Reader::Reset(std::istream& input) {
+    bit_reader_ = BitReader(input);
+    ResetState();
+}
+
+void Reader::Reset(std::span<const uint8_t> data) {
+    bit_reader_ = BitReader(data);
+    ResetState();
+}
+
+// Forgets everything read from the previous input. Sample and coefficient
+// buffers keep their capacity, the thread pool its threads.
+void Reader::ResetState() {
+    dqt_.fill(std::nullopt);
+    channels_cnt_ = 0;
+    huffman_defined_[0].fill(false);
+    huffman_defined_[1].fill(false);
+    read_sof_ = false;
+    progressive_ = false;
+    comment_.clear();
+    image_ = Image();
+    sink_ = nullptr;
+    width_ = 0;
+    height_ = 0;
+    requested_region_.reset();
+    h1_max_ = 0;
+    v1_max_ = 0;
+    restart_interval_ = 0;
+    eobrun_ = 0;
+}
+
+void Reader::CheckOptions() {
+    if (options_.scale != 1 && options_.scale != 2 && options_.scale != 4 &&
+        options_.scale != 8) {
+        throw std::invalid_argument("Unsupported scale");
+    }
+    block_size_ = 8 / options_.scale;
 }
 
 uint16_t Reader::ReadMarker() {
@@ -20,6 +76,9 @@ uint16_t Reader::ReadMarker() {
     if (k_app_from_ <= byte && byte <= k_app_to_) {
         byte = k_app_from_;
     }
+    if (k_rst_from_ <= byte && byte <= k_rst_to_) {
+        return byte;
+    }
     if (!k_markers_.contains(byte)) {
         throw std::runtime_error("Expected marker");
     }
@@ -47,14 +106,11 @@ void Reader::ReadCOM() {
     for (size_t i = 0; i < siz; ++i) {
         com += bit_reader_.Read1Byte();
     }
-    image_.SetComment(com);
+    comment_ = com;
 }
 
 void Reader::ReadApp() {
-    size_t siz = ReadBlockSize();
-    for (size_t i = 0; i < siz; ++i) {
-        bit_reader_.Read1Byte();
-    }
+    bit_reader_.SkipBytes(ReadBlockSize());
 }
 
 void Reader::ReadDQT() {
@@ -68,7 +124,10 @@ void Reader::ReadDQT() {
             throw std::runtime_error("Invalid value_size in DQT");
         }
         uint16_t idx = info & 0x0F;
-        std::vector<std::vector<int>> dqt(8, std::vector<int>(8, 0));
+        if (idx >= dqt_.size()) {
+            throw std::runtime_error("Invalid DQT index");
+        }
+        std::array<uint16_t, 64> dqt{};
         for (size_t ptr = 0; ptr < 64; ++ptr) {
             uint16_t value = bit_reader_.Read1Byte();
             ++read_bytes;
@@ -77,7 +136,7 @@ void Reader::ReadDQT() {
                 value |= bit_reader_.Read1Byte();
                 ++read_bytes;
             }
-            dqt[k_zigzag_order_[ptr] / 8][k_zigzag_order_[ptr] % 8] = value;
+            dqt[k_zigzag_order_[ptr]] = value;
         }
         dqt_[idx] = dqt;
     }
@@ -86,11 +145,12 @@ void Reader::ReadDQT() {
     }
 }
 
-void Reader::ReadSOF0() {
-    if (read_sof0_) {
+void Reader::ReadSOF(bool progressive) {
+    if (read_sof_) {
         throw std::runtime_error("Duplicate SOF0");
     }
-    read_sof0_ = true;
+    read_sof_ = true;
+    progressive_ = progressive;
     size_t siz = ReadBlockSize();
     size_t read_bytes = 0;
     size_t precision = bit_reader_.Read1Byte();
@@ -109,24 +169,36 @@ void Reader::ReadSOF0() {
     if (height == 0 || width == 0) {
         throw std::runtime_error("Invalid sizes in SOF0");
     }
-    image_.SetSize(width, height);
+    width_ = width;
+    height_ = height;
     size_t channels_cnt = bit_reader_.Read1Byte();
     ++read_bytes;
     if (channels_cnt != 1 && channels_cnt != 3) {
         throw std::runtime_error("Invalid number of channels in SOF0");
     }
     for (size_t i = 0; i < channels_cnt; ++i) {
-        size_t id = bit_reader_.Read1Byte();
+        Channel& channel = channels_[i];
+        channel = {};
+        channel.id = bit_reader_.Read1Byte();
         ++read_bytes;
+        for (size_t j = 0; j < i; ++j) {
+            if (channels_[j].id == channel.id) {
+                throw std::runtime_error("Duplicate channel in SOF0");
+            }
+        }
         uint16_t info = bit_reader_.Read1Byte();
-        channels_[id].h1 = (info & 0xF0) >> 4;
-        channels_[id].v1 = (info & 0x0F);
+        channel.h1 = (info & 0xF0) >> 4;
+        channel.v1 = (info & 0x0F);
+        if (channel.h1 < 1 || channel.h1 > 4 || channel.v1 < 1 || channel.v1 > 4) {
+            throw std::runtime_error("Invalid sampling factors in SOF0");
+        }
         ++read_bytes;
-        h1_max_ = std::max(h1_max_, channels_[id].h1);
-        v1_max_ = std::max(v1_max_, channels_[id].v1);
-        channels_[id].dqt_idx = bit_reader_.Read1Byte();
+        h1_max_ = std::max(h1_max_, channel.h1);
+        v1_max_ = std::max(v1_max_, channel.v1);
+        channel.dqt_idx = bit_reader_.Read1Byte();
         ++read_bytes;
     }
+    channels_cnt_ = channels_cnt;
     if (read_bytes != siz) {
         throw std::runtime_error("Invalid sof0 format");
     }
@@ -143,6 +215,9 @@ void Reader::ReadDHT() {
             throw std::runtime_error("Invalid value_size in DQT");
         }
         uint16_t idx = info & 0x0F;
+        if (idx >= huffmans_[0].size()) {
+            throw std::runtime_error("Invalid DHT index");
+        }
 
         std::vector<uint8_t> code_lengths(16, 0);
         std::vector<uint8_t> values;
@@ -157,166 +232,1067 @@ void Reader::ReadDHT() {
             values.emplace_back(bit_reader_.Read1Byte());
             ++read_bytes;
         }
+        huffman_defined_[coefs_class][idx] = false;
         huffmans_[coefs_class][idx].Build(code_lengths, values);
+        huffman_defined_[coefs_class][idx] = true;
     }
     if (read_bytes != siz) {
         throw std::runtime_error("Invalid DHT format");
     }
 }
 
-void Reader::ReadSOS() {
-    if (!read_sof0_) {
-        throw std::runtime_error("No SOF0 content");
+// Returns the table with id |idx|, or nullptr if there is none.
+const HuffmanTree* Reader::FindHuffman(size_t coefs_class, size_t idx) const {
+    if (idx >= huffmans_[coefs_class].size() || !huffman_defined_[coefs_class][idx]) {
+        return nullptr;
+    }
+    return &huffmans_[coefs_class][idx];
+}
+
+void Reader::ReadDRI() {
+    size_t siz = ReadBlockSize();
+    if (siz != 2) {
+        throw std::runtime_error("Invalid DRI format");
+    }
+    restart_interval_ = bit_reader_.Read1Byte();
+    restart_interval_ <<= 8;
+    restart_interval_ |= bit_reader_.Read1Byte();
+}
+
+// Allocates the output for the region of the image being decoded.
+void Reader::PrepareImage() {
+    size_t output_width = (width_ + options_.scale - 1) / options_.scale;
+    size_t output_height = (height_ + options_.scale - 1) / options_.scale;
+    region_ = requested_region_.value_or(Region{0, 0, output_width, output_height});
+    if (region_.x >= output_width || region_.y >= output_height || region_.width == 0 ||
+        region_.height == 0) {
+        throw std::invalid_argument("Region out of image");
+    }
+    region_.width = std::min(region_.width, output_width - region_.x);
+    region_.height = std::min(region_.height, output_height - region_.y);
+    // Subsampled planes are sized along with the components.
+    bool subsampled = options_.format == PixelFormat::kYCbCrSubsampled;
+    image_.SetSize(region_.width, sink_ || subsampled ? 0 : region_.height, options_.format);
+}
+
+// Computes the MCU grid, the layout of the components and the MCUs covering
+// the region.
+void Reader::PrepareFrame() {
+    mcus_w_ = (width_ + 8 * h1_max_ - 1) / (8 * h1_max_);
+    mcus_h_ = (height_ + 8 * v1_max_ - 1) / (8 * v1_max_);
+    size_t mcu_width = h1_max_ * block_size_;
+    size_t mcu_height = v1_max_ * block_size_;
+    bool subsampled = options_.format == PixelFormat::kYCbCrSubsampled;
+    bool fancy_h = false;
+    fancy_v_ = false;
+    scan_.resize(channels_cnt_);
+    for (size_t c = 0; c < scan_.size(); ++c) {
+        const Channel& channel = channels_[c];
+        ScanComponent& component = scan_[c];
+        component.h1 = channel.h1;
+        component.v1 = channel.v1;
+        // When scaling down, subsampled components keep more of their
+        // resolution, as far as that saves upsampling them afterwards.
+        // Subsampled output keeps the sampling of the image instead.
+        component.block_size = block_size_;
+        while (!subsampled && component.block_size < 8 &&
+               component.block_size * 2 * channel.h1 <= mcu_width &&
+               component.block_size * 2 * channel.v1 <= mcu_height) {
+            component.block_size *= 2;
+        }
+        size_t h_samples = channel.h1 * component.block_size;
+        size_t v_samples = channel.v1 * component.block_size;
+        component.width = (width_ * h_samples + 8 * h1_max_ - 1) / (8 * h1_max_);
+        component.height = (height_ * v_samples + 8 * v1_max_ - 1) / (8 * v1_max_);
+        // The cases libjpeg filters: h2v1 and h2v2 wider than two samples,
+        // and h1v2. Nothing is filtered without room for it in the blocks.
+        bool fancy = options_.upsampling == Upsampling::kFancy && block_size_ > 1 &&
+                     !subsampled && (c == 0 || options_.format != PixelFormat::kGray8);
+        bool half_h = h_samples * 2 == mcu_width;
+        bool half_v = v_samples * 2 == mcu_height;
+        if (half_h && (half_v || v_samples == mcu_height)) {
+            component.fancy_h = fancy && component.width > 2;
+            component.fancy_v = component.fancy_h && half_v;
+        } else {
+            component.fancy_h = false;
+            component.fancy_v = fancy && half_v && h_samples == mcu_width;
+        }
+        fancy_h |= component.fancy_h;
+        fancy_v_ |= component.fancy_v;
+
+        size_t right = (region_.x + region_.width) * h_samples;
+        size_t bottom = (region_.y + region_.height) * v_samples;
+        component.plane_x = region_.x * h_samples / mcu_width;
+        component.plane_y = region_.y * v_samples / mcu_height;
+        component.plane.width =
+            std::min((right + mcu_width - 1) / mcu_width, component.width) - component.plane_x;
+        component.plane.height =
+            std::min((bottom + mcu_height - 1) / mcu_height, component.height) -
+            component.plane_y;
+        component.plane.h_subsampling = mcu_width / h_samples;
+        component.plane.v_subsampling = mcu_height / v_samples;
+        component.plane.x_phase = region_.x % component.plane.h_subsampling;
+        component.plane.y_phase = region_.y % component.plane.v_subsampling;
+    }
+    if (subsampled && !sink_) {
+        // Grayscale images get neutral chroma planes of full resolution.
+        std::vector<PlaneSize> sizes(3, scan_[0].plane);
+        for (size_t c = 1; c < scan_.size(); ++c) {
+            sizes[c] = scan_[c].plane;
+        }
+        image_.SetSize(sizes, options_.format);
+    }
+
+    first_col_ = region_.x / mcu_width;
+    last_col_ = (region_.x + region_.width + mcu_width - 1) / mcu_width;
+    first_row_ = region_.y / mcu_height;
+    last_row_ = (region_.y + region_.height + mcu_height - 1) / mcu_height;
+    if (fancy_h) {
+        first_col_ -= first_col_ > 0;
+        last_col_ += last_col_ < mcus_w_;
+    }
+    if (fancy_v_) {
+        first_row_ -= first_row_ > 0;
+        last_row_ += last_row_ < mcus_h_;
     }
+}
+
+Reader::ScanHeader Reader::ReadScanHeader() {
     size_t siz = ReadBlockSize();
     size_t read_bytes = 0;
     size_t channels_cnt = bit_reader_.Read1Byte();
     ++read_bytes;
-    if (channels_cnt != 1 && channels_cnt != 3) {
+    if (channels_cnt < 1 || channels_cnt > channels_cnt_) {
         throw std::runtime_error("Invalid number of channels in SOS");
     }
+    ScanHeader header;
     for (size_t i = 0; i < channels_cnt; ++i) {
         size_t id = bit_reader_.Read1Byte();
         ++read_bytes;
         uint16_t info = bit_reader_.Read1Byte();
-        channels_info_[id].huffman_dc = (info & 0xF0) >> 4;
-        channels_info_[id].huffman_ac = (info & 0x0F);
         ++read_bytes;
+        // Components of a scan follow the order of the frame.
+        size_t index = 0;
+        while (index < channels_cnt_ && channels_[index].id != id) {
+            ++index;
+        }
+        if (index == channels_cnt_ ||
+            (!header.components.empty() && index <= header.components.back())) {
+            throw std::runtime_error("Invalid channel in SOS");
+        }
+        header.components.push_back(index);
+        channels_[index].huffman_dc = (info & 0xF0) >> 4;
+        channels_[index].huffman_ac = (info & 0x0F);
     }
+    header.ss = bit_reader_.Read1Byte();
+    header.se = bit_reader_.Read1Byte();
     uint16_t byte = bit_reader_.Read1Byte();
-    ++read_bytes;
-    if (byte != 0x00) {
+    header.ah = (byte & 0xF0) >> 4;
+    header.al = byte & 0x0F;
+    read_bytes += 3;
+    if (read_bytes != siz) {
         throw std::runtime_error("Invalid SOS format");
     }
-    byte = bit_reader_.Read1Byte();
-    ++read_bytes;
-    if (byte != 0x3F) {
+    return header;
+}
+
+void Reader::ReadSOS() {
+    PrepareImage();
+    ScanHeader header = ReadScanHeader();
+    if (header.components.size() != channels_cnt_ || header.ss != 0 ||
+        header.se != 0x3F || header.ah != 0 || header.al != 0) {
         throw std::runtime_error("Invalid SOS format");
     }
-    byte = bit_reader_.Read1Byte();
-    ++read_bytes;
-    if (byte != 0x00) {
-        throw std::runtime_error("Invalid SOS format");
+    PrepareFrame();
+
+    size_t intervals = 1;
+    if (restart_interval_) {
+        intervals = (mcus_w_ * mcus_h_ + restart_interval_ - 1) / restart_interval_;
+    }
+    bool parallel = options_.threads != 1 && !sink_;
+    if (intervals > 1 && parallel) {
+        DecodeIntervals();
+        return;
+    }
+    if (mcus_h_ > 1 && parallel && Pool().Size() > 1) {
+        DecodePipelined();
+        return;
     }
 
-    if (read_bytes != siz) {
-        throw std::runtime_error("Invalid SOS format");
+    PrepareScan(1, 1);
+    SkipIntervals();
+    InverseDct idct(options_.idct);
+    for (size_t mcu_row = mcus_decoded_ / mcus_w_; mcu_row < last_row_; ++mcu_row) {
+        DecodeMcuRow(0);
+        if (mcu_row >= first_row_) {
+            TransformMcuRow(idct, 0);
+            WriteMcuRow(mcu_row, 0);
+        }
+    }
+    FinishScan();
+}
+
+// Resolves the quantization tables of the components and sizes their
+// samples: room for |sample_slots| MCU rows, as wide as the region.
+void Reader::PrepareComponents(size_t sample_slots) {
+    for (size_t c = 0; c < scan_.size(); ++c) {
+        const Channel& channel = channels_[c];
+        ScanComponent& component = scan_[c];
+        if (channel.dqt_idx >= dqt_.size() || !dqt_[channel.dqt_idx]) {
+            throw std::runtime_error("No dqt matrix for channel");
+        }
+        component.quant = dqt_[channel.dqt_idx]->data();
+        component.stride = (last_col_ - first_col_) * channel.h1 * component.block_size;
+        component.samples.resize(component.stride * channel.v1 * component.block_size *
+                                 sample_slots);
+        if (fancy_v_) {
+            component.edges.resize(component.stride * 2 * (last_row_ - first_row_));
+        }
+        PrepareRowBuffers(c, sample_slots);
     }
+    if (fancy_v_) {
+        seams_ = std::make_unique<std::atomic<uint8_t>[]>(last_row_ - first_row_);
+    }
+    emitted_rows_ = 0;
+}
+
+// Sizes the row buffers of WriteRows for component |c|, see there.
+void Reader::PrepareRowBuffers(size_t c, size_t sample_slots) {
+    ScanComponent& component = scan_[c];
+    component.padded.clear();
+    component.sums.clear();
+    component.upsampled.clear();
+    component.columns.clear();
+    PixelFormat format = options_.format;
+    if (format == PixelFormat::kYCbCrSubsampled || (format == PixelFormat::kGray8 && c > 0)) {
+        return;
+    }
+    size_t count = (region_.x + region_.width - 1) / 2 - region_.x / 2 + 1;
+    size_t scale = component.h1 * component.block_size;
+    if (scale * 2 == h1_max_ * block_size_) {
+        component.padded.resize(2 * (count + 2) * sample_slots);
+        if (component.fancy_v) {
+            component.sums.resize((count + 2) * sample_slots);
+        }
+        component.upsampled.resize(2 * count * sample_slots);
+    } else if (scale != h1_max_ * block_size_) {
+        size_t offset = region_.x - first_col_ * h1_max_ * block_size_;
+        component.columns.resize(region_.width);
+        for (size_t x = 0; x < region_.width; ++x) {
+            component.columns[x] = (offset + x) * scale / (h1_max_ * block_size_);
+        }
+        component.upsampled.resize(2 * count * sample_slots);
+    } else if (component.fancy_v) {
+        component.upsampled.resize(2 * count * sample_slots);
+    }
+}
+
+// Resolves the tables of the components of the baseline scan and sizes the
+// buffers: |sample_slots| MCU rows of samples and |coefficient_slots| MCU rows
+// of coefficients.
+void Reader::PrepareScan(size_t sample_slots, size_t coefficient_slots) {
+    PrepareComponents(sample_slots);
+    blocks_per_mcu_ = 0;
+    for (size_t c = 0; c < scan_.size(); ++c) {
+        ScanComponent& component = scan_[c];
+        component.huffman_dc = FindHuffman(0, channels_[c].huffman_dc);
+        component.huffman_ac = FindHuffman(1, channels_[c].huffman_ac);
+        if (!component.huffman_dc || !component.huffman_ac) {
+            throw std::runtime_error("No huffman table for channel");
+        }
+        blocks_per_mcu_ += component.h1 * component.v1;
+    }
+    // Common layouts have loops of their own: one block of every chroma
+    // component, and one to four of luma.
+    decode_mcus_ = &Reader::DecodeMcus<0, 0>;
+    bool chroma_blocks = std::all_of(scan_.begin() + 1, scan_.end(), [](const auto& component) {
+        return component.h1 * component.v1 == 1;
+    });
+    if (chroma_blocks && (scan_.size() == 1 || scan_.size() == 3)) {
+        size_t luma_blocks = scan_[0].h1 * scan_[0].v1;
+        bool color = scan_.size() == 3;
+        if (luma_blocks == 1) {
+            decode_mcus_ = color ? &Reader::DecodeMcus<3, 1> : &Reader::DecodeMcus<1, 1>;
+        } else if (luma_blocks == 2 && color) {
+            decode_mcus_ = &Reader::DecodeMcus<3, 2>;
+        } else if (luma_blocks == 4 && color) {
+            decode_mcus_ = &Reader::DecodeMcus<3, 4>;
+        }
+    }
+    coefficients_.resize(mcus_w_ * blocks_per_mcu_ * 64 * coefficient_slots);
+    prev_dc_.fill(0);
+    mcus_decoded_ = 0;
+    restarts_ = 0;
+}
 
-    size_t blocks_w = (image_.Width() + 8 * h1_max_ - 1) / (8 * h1_max_);
-    size_t blocks_h = (image_.Height() + 8 * v1_max_ - 1) / (8 * v1_max_);
-
-    bit_reader_.ReadSos();
-    bit_reader_.flag_ = 1;
-    for (size_t block_i = 0; block_i < blocks_h; ++block_i) {
-        for (size_t block_j = 0; block_j < blocks_w; ++block_j) {
-            std::vector<std::vector<std::vector<std::vector<std::vector<int>>>>> mcu(
-                channels_cnt + 1, std::vector<std::vector<std::vector<std::vector<int>>>>(
-                                      v1_max_, std::vector<std::vector<std::vector<int>>>(
-                                                   h1_max_, std::vector<std::vector<int>>(
-                                                                8, std::vector<int>(8, 0)))));
-            for (size_t ch = 1; ch < channels_cnt + 1; ++ch) {
-                if (!channels_.contains(ch)) {
-                    throw std::runtime_error("No meta about channel");
+bool Reader::InRegion(size_t mcu) const {
+    size_t mcu_row = mcu / mcus_w_;
+    size_t mcu_col = mcu % mcus_w_;
+    return first_row_ <= mcu_row && mcu_row < last_row_ && first_col_ <= mcu_col &&
+           mcu_col < last_col_;
+}
+
+// Restart intervals before the first MCU of the region are skipped without
+// decoding them, leaving the input at the marker which ends the last one.
+void Reader::SkipIntervals() {
+    if (!restart_interval_) {
+        return;
+    }
+    size_t count = (first_row_ * mcus_w_ + first_col_) / restart_interval_;
+    for (size_t k = 0; k < count; ++k) {
+        if (k) {
+            ReadRestart();
+        }
+        bit_reader_.FinishSos();
+    }
+    mcus_decoded_ = count * restart_interval_;
+}
+
+// Positions the input at the marker which ends the scan, skipping the data
+// of the MCUs below the region.
+void Reader::FinishScan() {
+    if (last_row_ < mcus_h_) {
+        bit_reader_.SkipSegment();
+    }
+    bit_reader_.FinishSos();
+}
+
+// Decodes the rest of the current MCU row into |slot|.
+void Reader::DecodeMcuRow(size_t slot) {
+    size_t row_size = mcus_w_ * blocks_per_mcu_ * 64;
+    int16_t* block = coefficients_.data() + slot * row_size;
+    std::fill(block, block + row_size, 0);
+    block += (mcus_decoded_ % mcus_w_) * blocks_per_mcu_ * 64;
+    // Runs of MCUs up to the end of the row or the next restart marker.
+    for (size_t mcu = mcus_decoded_ % mcus_w_; mcu < mcus_w_;) {
+        size_t count = mcus_w_ - mcu;
+        if (restart_interval_) {
+            if (mcus_decoded_ && mcus_decoded_ % restart_interval_ == 0) {
+                ReadRestart();
+            }
+            count = std::min(count, restart_interval_ - mcus_decoded_ % restart_interval_);
+        }
+        (this->*decode_mcus_)(bit_reader_, prev_dc_.data(), block, count);
+        block += count * blocks_per_mcu_ * 64;
+        mcu += count;
+        mcus_decoded_ += count;
+    }
+}
+
+// Decodes |mcus| MCUs into |blocks|, which are zeroed. Layouts with
+// kComponents components of one block each but kLumaBlocks for the first
+// have the number of blocks fixed at compile time; <0, 0> takes any from
+// scan_.
+template <size_t kComponents, size_t kLumaBlocks>
+void Reader::DecodeMcus(BitReader& bit_reader, int* prev_dc, int16_t* blocks,
+                        size_t mcus) const {
+    for (size_t mcu = 0; mcu < mcus; ++mcu) {
+        if constexpr (kComponents == 0) {
+            for (size_t c = 0; c < scan_.size(); ++c) {
+                size_t count = scan_[c].h1 * scan_[c].v1;
+                for (size_t i = 0; i < count; ++i, blocks += 64) {
+                    DecodeBlock(bit_reader, scan_[c], prev_dc[c], blocks);
                 }
-                if (!channels_info_.contains(ch)) {
-                    throw std::runtime_error("No info about channel");
+            }
+        } else {
+            for (size_t i = 0; i < kLumaBlocks; ++i, blocks += 64) {
+                DecodeBlock(bit_reader, scan_[0], prev_dc[0], blocks);
+            }
+            for (size_t c = 1; c < kComponents; ++c, blocks += 64) {
+                DecodeBlock(bit_reader, scan_[c], prev_dc[c], blocks);
+            }
+        }
+    }
+}
+
+// Restart markers realign the data to a byte and reset DC prediction.
+void Reader::ReadRestart() {
+    bit_reader_.FinishSos();
+    uint16_t marker = ReadMarker();
+    if (marker != k_rst_from_ + restarts_ % 8) {
+        throw std::runtime_error("Expected restart marker");
+    }
+    ++restarts_;
+    prev_dc_.fill(0);
+    eobrun_ = 0;
+}
+
+// Splits the entropy-coded segment at the restart markers and decodes the
+// intervals concurrently into sample planes holding the whole region, since
+// every interval starts byte-aligned with fresh DC predictions. Intervals
+// outside the region are not decoded at all.
+void Reader::DecodeIntervals() {
+    PrepareScan(last_row_ - first_row_, 0);
+    std::span<const uint8_t> segment = bit_reader_.ReadSegment();
+    std::vector<std::pair<size_t, size_t>> ranges;
+    size_t begin = 0;
+    for (size_t i = 0; i + 1 < segment.size(); ++i) {
+        if (segment[i] != 0xFF) {
+            continue;
+        }
+        if (segment[i + 1] != 0x00) {
+            if (segment[i + 1] != k_rst_from_ + ranges.size() % 8) {
+                throw std::runtime_error("Expected restart marker");
+            }
+            ranges.emplace_back(begin, i);
+            begin = i + 2;
+        }
+        ++i;
+    }
+    ranges.emplace_back(begin, segment.size());
+
+    size_t mcus_cnt = mcus_w_ * mcus_h_;
+    if (ranges.size() != (mcus_cnt + restart_interval_ - 1) / restart_interval_) {
+        throw std::runtime_error("Unexpected number of restart intervals");
+    }
+    // Every task decodes one contiguous run of the intervals reaching into the
+    // rows of the region, with one IDCT and block buffer for all of them.
+    size_t first = first_row_ * mcus_w_ / restart_interval_;
+    size_t last = std::min(ranges.size(),
+                           (last_row_ * mcus_w_ + restart_interval_ - 1) / restart_interval_);
+    size_t tasks = std::min(Pool().Size(), last - first);
+    Pool().ParallelFor(tasks, [&](size_t t) {
+        InverseDct idct(options_.idct);
+        AlignedVector<int16_t> blocks(blocks_per_mcu_ * 64);
+        size_t end = first + (last - first) * (t + 1) / tasks;
+        for (size_t k = first + (last - first) * t / tasks; k < end; ++k) {
+            size_t first_mcu = k * restart_interval_;
+            DecodeInterval(idct, blocks, segment.data() + ranges[k].first,
+                           ranges[k].second - ranges[k].first, first_mcu,
+                           std::min(restart_interval_, mcus_cnt - first_mcu));
+        }
+    });
+    Pool().ParallelFor(last_row_ - first_row_,
+                       [&](size_t slot) { WriteMcuRow(first_row_ + slot, slot); });
+    bit_reader_.FinishSos();
+}
+
+// Without restart markers entropy decoding is inherently sequential, but the
+// rest of the work is not. Every task takes the next MCU row, waits for its
+// turn to entropy decode it into a free slot of the row ring, and hands the
+// bit reader on to the next row before the IDCT and color conversion, so
+// those overlap with the decoding of the following rows. Tasks are started
+// in row order and run until they finish, so the row holding the turn is
+// always running; at most Size() rows are in flight, one per slot.
+void Reader::DecodePipelined() {
+    size_t slots = Pool().Size();
+    PrepareScan(slots, slots);
+    SkipIntervals();
+    size_t start_row = mcus_decoded_ / mcus_w_;
+
+    std::mutex mutex;
+    std::condition_variable turn_passed;
+    size_t turn = 0;
+    bool failed = false;
+    std::vector<size_t> free_slots(slots);
+    std::iota(free_slots.begin(), free_slots.end(), 0);
+
+    Pool().ParallelFor(last_row_ - start_row, [&](size_t k) {
+        size_t slot;
+        {
+            std::unique_lock lock(mutex);
+            turn_passed.wait(lock, [&] { return turn == k || failed; });
+            if (failed) {
+                return;
+            }
+            slot = free_slots.back();
+            free_slots.pop_back();
+        }
+        try {
+            DecodeMcuRow(slot);
+        } catch (...) {
+            std::lock_guard lock(mutex);
+            failed = true;
+            turn_passed.notify_all();
+            throw;
+        }
+        {
+            std::lock_guard lock(mutex);
+            ++turn;
+        }
+        turn_passed.notify_all();
+
+        size_t mcu_row = start_row + k;
+        if (mcu_row >= first_row_) {
+            InverseDct idct(options_.idct);
+            TransformMcuRow(idct, slot);
+            WriteMcuRow(mcu_row, slot);
+        }
+        std::lock_guard lock(mutex);
+        free_slots.push_back(slot);
+    });
+    FinishScan();
+}
+
+// Decodes |mcus_cnt| MCUs from |first_mcu| on, up to the last one in the
+// region, and transforms those in the region into the sample planes with
+// |idct|. |blocks| holds the coefficients of one MCU.
+void Reader::DecodeInterval(InverseDct& idct, AlignedVector<int16_t>& blocks, const uint8_t* data,
+                            size_t size, size_t first_mcu, size_t mcus_cnt) {
+    size_t end_mcu = first_mcu + mcus_cnt;
+    while (end_mcu > first_mcu && !InRegion(end_mcu - 1)) {
+        --end_mcu;
+    }
+    if (end_mcu == first_mcu) {
+        return;
+    }
+    BitReader bit_reader({data, size});
+    std::array<int, 4> prev_dc = {};
+    for (size_t mcu = first_mcu; mcu < end_mcu; ++mcu) {
+        std::fill(blocks.begin(), blocks.end(), 0);
+        (this->*decode_mcus_)(bit_reader, prev_dc.data(), blocks.data(), 1);
+        if (!InRegion(mcu)) {
+            continue;
+        }
+        size_t slot = mcu / mcus_w_ - first_row_;
+        size_t mcu_col = mcu % mcus_w_ - first_col_;
+        const int16_t* block = blocks.data();
+        for (auto& component : scan_) {
+            for (size_t i = 0; i < component.v1; ++i) {
+                for (size_t j = 0; j < component.h1; ++j, block += 64) {
+                    // Planes are shared between tasks, but every block is only
+                    // written by the task owning its MCU.
+                    size_t y = (slot * component.v1 + i) * component.block_size;
+                    size_t x = (mcu_col * component.h1 + j) * component.block_size;
+                    uint8_t* output = component.samples.data() + y * component.stride + x;
+                    idct.Transform(block, component.quant, output, component.stride,
+                                   component.block_size);
                 }
-                for (int i = 0; i < channels_[ch].v1; ++i) {
-                    for (int j = 0; j < channels_[ch].h1; ++j) {
-                        int dc00_len = 0;
-                        while (!huffmans_[0][channels_info_[ch].huffman_dc].Move(
-                            bit_reader_.NextBit(), dc00_len)) {
-                        }
-                        int val = 0;
-                        for (int k = 0; k < dc00_len; ++k) {
-                            val <<= 1;
-                            val |= bit_reader_.NextBit();
-                        }
-                        if ((val & (1 << (dc00_len - 1))) == 0) {
-                            val = val - (1 << dc00_len) + 1;
-                        }
-                        mcu[ch][i][j][0][0] = val;
-                        mcu[ch][i][j][0][0] += prev_dc_val_[ch];
-                        prev_dc_val_[ch] = mcu[ch][i][j][0][0];
-
-                        size_t ptr = 1;
-                        for (; ptr < 64;) {
-                            val = 0;
-                            while (!huffmans_[1][channels_info_[ch].huffman_ac].Move(
-                                bit_reader_.NextBit(), val)) {
-                            }
-                            if (val == 0) {
-                                break;
-                            }
-                            size_t add_zero = (val & 0xF0) >> 4;
-                            for (size_t c = 0; c < add_zero; ++c) {
-                                mcu[ch][i][j][k_zigzag_order_[ptr] / 8][k_zigzag_order_[ptr] % 8] =
-                                    0;
-                                ++ptr;
-                            }
-                            int ac_len = val & 0x0F;
-                            val = 0;
-                            for (int k = 0; k < ac_len; ++k) {
-                                val <<= 1;
-                                val |= bit_reader_.NextBit();
-                            }
-                            if ((val & (1 << (ac_len - 1))) == 0) {
-                                val = val - (1 << ac_len) + 1;
-                            }
-                            mcu[ch][i][j][k_zigzag_order_[ptr] / 8][k_zigzag_order_[ptr] % 8] = val;
-                            ++ptr;
-                        }
-                        for (; ptr < 64; ++ptr) {
-                            mcu[ch][i][j][k_zigzag_order_[ptr] / 8][k_zigzag_order_[ptr] % 8] = 0;
-                        }
-                        if (!dqt_.contains(channels_[ch].dqt_idx)) {
-                            throw std::runtime_error("No dqt matrix for channel");
-                        }
-                        std::vector<double> input(64);
-                        std::vector<double> output(64, 0);
-                        for (size_t ii = 0; ii < 8; ++ii) {
-                            for (size_t jj = 0; jj < 8; ++jj) {
-                                mcu[ch][i][j][ii][jj] *= dqt_[channels_[ch].dqt_idx][ii][jj];
-                                input[ii * 8 + jj] = mcu[ch][i][j][ii][jj];
-                            }
-                        }
-                        DctCalculator calculator(8, &input, &output);
-                        calculator.Inverse();
-
-                        for (size_t ii = 0; ii < 8; ++ii) {
-                            for (size_t jj = 0; jj < 8; ++jj) {
-                                mcu[ch][i][j][ii][jj] = std::round(output[ii * 8 + jj]);
-                                mcu[ch][i][j][ii][jj] =
-                                    std::min(std::max(0, mcu[ch][i][j][ii][jj] + 128), 255);
-                            }
+            }
+        }
+    }
+}
+
+void Reader::DecodeBlock(BitReader& bit_reader, const ScanComponent& component, int& prev_dc,
+                         int16_t* block) const {
+    int dc00_len = 0;
+    bit_reader.SkipBits(component.huffman_dc->Decode(bit_reader.PeekBits(16), dc00_len));
+    if (dc00_len > 16) {
+        throw std::runtime_error("Invalid DC coefficient length");
+    }
+    int val = HuffmanTree::Extend(bit_reader.GetBits(dc00_len), dc00_len);
+    prev_dc += val;
+    block[0] = prev_dc;
+
+    const HuffmanTree& huffman_ac = *component.huffman_ac;
+    for (size_t ptr = 1; ptr < 64; ++ptr) {
+        int coefficient = 0;
+        size_t length = huffman_ac.DecodeCoefficient(bit_reader.PeekBits(16), val, coefficient);
+        if (length) {
+            bit_reader.SkipBits(length);
+        } else {
+            bit_reader.SkipBits(huffman_ac.Decode(bit_reader.PeekBits(16), val));
+            int ac_len = val & 0x0F;
+            coefficient = HuffmanTree::Extend(bit_reader.GetBits(ac_len), ac_len);
+        }
+        if (val == 0) {
+            break;
+        }
+        ptr += (val & 0xF0) >> 4;
+        if (ptr >= 64) {
+            throw std::runtime_error("AC coefficients out of block");
+        }
+        block[k_zigzag_order_[ptr]] = coefficient;
+    }
+}
+
+// Transforms the MCUs of the region in |slot|.
+void Reader::TransformMcuRow(InverseDct& idct, size_t slot) {
+    const int16_t* block = coefficients_.data() + slot * mcus_w_ * blocks_per_mcu_ * 64 +
+                           first_col_ * blocks_per_mcu_ * 64;
+    for (size_t mcu = 0; mcu < last_col_ - first_col_; ++mcu) {
+        for (auto& component : scan_) {
+            for (size_t i = 0; i < component.v1; ++i) {
+                for (size_t j = 0; j < component.h1; ++j, block += 64) {
+                    size_t y = (slot * component.v1 + i) * component.block_size;
+                    size_t x = (mcu * component.h1 + j) * component.block_size;
+                    uint8_t* output = component.samples.data() + y * component.stride + x;
+                    idct.Transform(block, component.quant, output, component.stride,
+                                   component.block_size);
+                }
+            }
+        }
+    }
+}
+
+// Decodes every scan of a progressive image into the coefficient buffers,
+// then transforms the region once all of them are in, or after every scan
+// too when previews are requested.
+void Reader::DecodeProgressive() {
+    PrepareImage();
+    PrepareFrame();
+    progressive_coefficients_.resize(channels_cnt_);
+    for (size_t c = 0; c < channels_cnt_; ++c) {
+        const Channel& channel = channels_[c];
+        progressive_coefficients_[c].assign(mcus_w_ * channel.h1 * mcus_h_ * channel.v1 * 64, 0);
+    }
+    uint16_t marker = k_sos_;
+    for (size_t scans = 1; marker == k_sos_; ++scans) {
+        DecodeProgressiveScan(ReadScanHeader());
+        marker = ReadSegments();
+        if (marker == k_sos_ && options_.progressive_preview && !sink_) {
+            TransformProgressive();
+            if (!options_.progressive_preview(image_, scans)) {
+                return;
+            }
+        }
+    }
+    TransformProgressive();
+}
+
+void Reader::DecodeProgressiveScan(const ScanHeader& header) {
+    bool dc = header.ss == 0;
+    if (header.se > 63 || header.ss > header.se || dc != (header.se == 0) ||
+        (!dc && header.components.size() != 1) || (header.ah && header.ah != header.al + 1) ||
+        header.al > 13) {
+        throw std::runtime_error("Invalid SOS format");
+    }
+    // DC refinement scans carry raw bits only.
+    std::vector<const HuffmanTree*> huffmans(header.components.size());
+    for (size_t k = 0; k < huffmans.size() && !(dc && header.ah); ++k) {
+        const Channel& channel = channels_[header.components[k]];
+        huffmans[k] =
+            dc ? FindHuffman(0, channel.huffman_dc) : FindHuffman(1, channel.huffman_ac);
+        if (!huffmans[k]) {
+            throw std::runtime_error("No huffman table for channel");
+        }
+    }
+    prev_dc_.fill(0);
+    eobrun_ = 0;
+    mcus_decoded_ = 0;
+    restarts_ = 0;
+
+    auto decode_block = [&](size_t k, int16_t* block) {
+        if (dc && !header.ah) {
+            DecodeDcFirst(*huffmans[k], prev_dc_[k], block, header.al);
+        } else if (dc) {
+            DecodeDcRefine(block, header.al);
+        } else if (!header.ah) {
+            DecodeAcFirst(*huffmans[k], block, header.ss, header.se, header.al);
+        } else {
+            DecodeAcRefine(*huffmans[k], block, header.ss, header.se, header.al);
+        }
+    };
+    auto next_mcu = [&] {
+        if (restart_interval_ && mcus_decoded_ && mcus_decoded_ % restart_interval_ == 0) {
+            ReadRestart();
+        }
+        ++mcus_decoded_;
+    };
+
+    if (header.components.size() == 1) {
+        // A scan of a single component covers only the blocks inside its own
+        // part of the image, one block per MCU.
+        size_t c = header.components[0];
+        const Channel& channel = channels_[c];
+        size_t blocks_w = (width_ * channel.h1 + 8 * h1_max_ - 1) / (8 * h1_max_);
+        size_t blocks_h = (height_ * channel.v1 + 8 * v1_max_ - 1) / (8 * v1_max_);
+        size_t stride = mcus_w_ * channel.h1;
+        int16_t* coefficients = progressive_coefficients_[c].data();
+        for (size_t y = 0; y < blocks_h; ++y) {
+            for (size_t x = 0; x < blocks_w; ++x) {
+                next_mcu();
+                decode_block(0, coefficients + (y * stride + x) * 64);
+            }
+        }
+    } else {
+        for (size_t mcu_row = 0; mcu_row < mcus_h_; ++mcu_row) {
+            for (size_t mcu_col = 0; mcu_col < mcus_w_; ++mcu_col) {
+                next_mcu();
+                for (size_t k = 0; k < header.components.size(); ++k) {
+                    size_t c = header.components[k];
+                    const Channel& channel = channels_[c];
+                    size_t stride = mcus_w_ * channel.h1;
+                    int16_t* coefficients = progressive_coefficients_[c].data();
+                    for (size_t i = 0; i < channel.v1; ++i) {
+                        for (size_t j = 0; j < channel.h1; ++j) {
+                            size_t y = mcu_row * channel.v1 + i;
+                            size_t x = mcu_col * channel.h1 + j;
+                            decode_block(k, coefficients + (y * stride + x) * 64);
                         }
                     }
                 }
             }
-            for (size_t i = 0; i < v1_max_ * 8; ++i) {
-                for (size_t j = 0; j < h1_max_ * 8; ++j) {
-
-                    std::vector<int> ycbcr(3, 0);
-                    for (size_t c = 1; c <= channels_cnt; ++c) {
-                        int a = i * channels_[c].v1 / v1_max_;
-                        int b = j * channels_[c].h1 / h1_max_;
-                        ycbcr[c - 1] = mcu[c][a / 8][b / 8][a % 8][b % 8];
-                    }
-                    RGB pixel;
-                    if (channels_cnt == 1) {
-                        pixel = {ycbcr[0], ycbcr[0], ycbcr[0]};
-                    } else {
-                        pixel = YCbCrToRGB(ycbcr[0], ycbcr[1], ycbcr[2]);
-                    }
-                    size_t y = block_i * 8 * v1_max_ + i;
-                    size_t x = block_j * 8 * h1_max_ + j;
-                    if (y < image_.Height() && x < image_.Width()) {
-                        image_.SetPixel(y, x, pixel);
-                    }
+        }
+    }
+    bit_reader_.FinishSos();
+}
+
+void Reader::DecodeDcFirst(const HuffmanTree& huffman, int& prev_dc, int16_t* block,
+                           size_t al) {
+    int length = 0;
+    bit_reader_.SkipBits(huffman.Decode(bit_reader_.PeekBits(16), length));
+    if (length > 16) {
+        throw std::runtime_error("Invalid DC coefficient length");
+    }
+    prev_dc += HuffmanTree::Extend(bit_reader_.GetBits(length), length);
+    block[0] = prev_dc * (1 << al);
+}
+
+void Reader::DecodeDcRefine(int16_t* block, size_t al) {
+    if (bit_reader_.GetBits(1)) {
+        block[0] |= 1 << al;
+    }
+}
+
+void Reader::DecodeAcFirst(const HuffmanTree& huffman, int16_t* block, size_t ss, size_t se,
+                           size_t al) {
+    if (eobrun_) {
+        --eobrun_;
+        return;
+    }
+    for (size_t ptr = ss; ptr <= se; ++ptr) {
+        int val = 0;
+        bit_reader_.SkipBits(huffman.Decode(bit_reader_.PeekBits(16), val));
+        size_t run = (val & 0xF0) >> 4;
+        size_t length = val & 0x0F;
+        if (length) {
+            ptr += run;
+            if (ptr > se) {
+                throw std::runtime_error("AC coefficients out of block");
+            }
+            block[k_zigzag_order_[ptr]] =
+                HuffmanTree::Extend(bit_reader_.GetBits(length), length) * (1 << al);
+        } else if (run == 15) {
+            ptr += 15;
+        } else {
+            // The run counts this block too.
+            eobrun_ = (1 << run) - 1;
+            if (run) {
+                eobrun_ += bit_reader_.GetBits(run);
+            }
+            break;
+        }
+    }
+}
+
+// Adds one bit of precision to the coefficients of the band: nonzero ones
+// get a correction bit each, and newly nonzero ones are placed among the
+// zeros, which is what the run lengths count.
+void Reader::DecodeAcRefine(const HuffmanTree& huffman, int16_t* block, size_t ss, size_t se,
+                            size_t al) {
+    int p1 = 1 << al;
+    auto refine = [&](int16_t& coefficient) {
+        if (bit_reader_.GetBits(1) && (coefficient & p1) == 0) {
+            coefficient += coefficient >= 0 ? p1 : -p1;
+        }
+    };
+    size_t ptr = ss;
+    if (!eobrun_) {
+        for (; ptr <= se; ++ptr) {
+            int val = 0;
+            bit_reader_.SkipBits(huffman.Decode(bit_reader_.PeekBits(16), val));
+            size_t run = (val & 0xF0) >> 4;
+            size_t length = val & 0x0F;
+            int coefficient = 0;
+            if (length) {
+                if (length != 1) {
+                    throw std::runtime_error("Invalid AC refinement");
+                }
+                coefficient = bit_reader_.GetBits(1) ? p1 : -p1;
+            } else if (run != 15) {
+                eobrun_ = 1 << run;
+                if (run) {
+                    eobrun_ += bit_reader_.GetBits(run);
+                }
+                break;
+            }
+            for (; ptr <= se; ++ptr) {
+                int16_t& current = block[k_zigzag_order_[ptr]];
+                if (current) {
+                    refine(current);
+                } else if (run) {
+                    --run;
+                } else {
+                    break;
+                }
+            }
+            if (coefficient) {
+                if (ptr > se) {
+                    throw std::runtime_error("AC coefficients out of block");
+                }
+                block[k_zigzag_order_[ptr]] = coefficient;
+            }
+        }
+    }
+    if (eobrun_) {
+        for (; ptr <= se; ++ptr) {
+            int16_t& current = block[k_zigzag_order_[ptr]];
+            if (current) {
+                refine(current);
+            }
+        }
+        --eobrun_;
+    }
+}
+
+// Transforms the MCU rows of the region from the coefficient buffers and
+// converts them, in parallel unless a single thread is requested.
+void Reader::TransformProgressive() {
+    size_t rows = last_row_ - first_row_;
+    bool parallel = options_.threads != 1 && rows > 1 && !sink_;
+    PrepareComponents(parallel ? rows : 1);
+    auto transform_row = [&](size_t k) {
+        size_t slot = parallel ? k : 0;
+        size_t mcu_row = first_row_ + k;
+        InverseDct idct(options_.idct);
+        for (size_t c = 0; c < scan_.size(); ++c) {
+            ScanComponent& component = scan_[c];
+            size_t stride = mcus_w_ * component.h1;
+            for (size_t i = 0; i < component.v1; ++i) {
+                const int16_t* block = progressive_coefficients_[c].data() +
+                                       ((mcu_row * component.v1 + i) * stride +
+                                        first_col_ * component.h1) * 64;
+                size_t y = (slot * component.v1 + i) * component.block_size;
+                for (size_t x = 0; x < component.stride; x += component.block_size, block += 64) {
+                    uint8_t* output = component.samples.data() + y * component.stride + x;
+                    idct.Transform(block, component.quant, output, component.stride,
+                                   component.block_size);
+                }
+            }
+        }
+        WriteMcuRow(mcu_row, slot);
+    };
+    if (parallel) {
+        Pool().ParallelFor(rows, transform_row);
+    } else {
+        for (size_t k = 0; k < rows; ++k) {
+            transform_row(k);
+        }
+    }
+}
+
+ThreadPool& Reader::Pool() {
+    if (!pool_) {
+        pool_ = std::make_unique<ThreadPool>(options_.threads);
+    }
+    return *pool_;
+}
+
+// Keeps the first and the last sample row of |mcu_row|, kept in |slot|, for
+// the seams with the MCU rows around it.
+void Reader::SaveEdges(size_t mcu_row, size_t slot) {
+    for (auto& component : scan_) {
+        size_t rows = component.v1 * component.block_size;
+        const uint8_t* first = component.samples.data() + slot * rows * component.stride;
+        const uint8_t* last = first + (rows - 1) * component.stride;
+        uint8_t* edges = component.edges.data() + (mcu_row - first_row_) * 2 * component.stride;
+        std::copy(first, first + component.stride, edges);
+        std::copy(last, last + component.stride, edges + component.stride);
+    }
+}
+
+// Sample row |row| of component |c|, from |mcu_row| in |slot| or from the
+// edges of the MCU row next to it.
+const uint8_t* Reader::SampleRow(size_t c, size_t mcu_row, size_t slot, size_t row) const {
+    const ScanComponent& component = scan_[c];
+    size_t rows = component.v1 * component.block_size;
+    if (row < mcu_row * rows) {
+        return component.edges.data() + ((mcu_row - 1 - first_row_) * 2 + 1) * component.stride;
+    }
+    if (row >= (mcu_row + 1) * rows) {
+        return component.edges.data() + (mcu_row + 1 - first_row_) * 2 * component.stride;
+    }
+    return component.samples.data() + (slot * rows + row - mcu_row * rows) * component.stride;
+}
+
+// Converts the samples of |mcu_row|, kept in |slot|, into the pixels of the
+// region, and passes them on to sink_ if there is one.
+void Reader::WriteMcuRow(size_t mcu_row, size_t slot) {
+    if (image_.Format() == PixelFormat::kYCbCrSubsampled) {
+        CopyPlanes(mcu_row, slot);
+        return;
+    }
+    size_t mcu_height = v1_max_ * block_size_;
+    size_t begin = mcu_row * mcu_height;
+    size_t end = begin + mcu_height;
+    bool above = false;
+    bool below = false;
+    if (fancy_v_) {
+        SaveEdges(mcu_row, slot);
+        above = mcu_row > first_row_ &&
+                seams_[mcu_row - 1 - first_row_].fetch_add(1, std::memory_order_acq_rel) == 1;
+        below = mcu_row + 1 < last_row_ &&
+                seams_[mcu_row - first_row_].fetch_add(1, std::memory_order_acq_rel) == 1;
+        begin += mcu_row > first_row_;
+        end -= mcu_row + 1 < last_row_;
+    }
+    if (sink_) {
+        // Sequentially, the seam above is always complete and the one below
+        // never is, so the band runs from the last row of the MCU row above.
+        size_t band_end = std::clamp(end, region_.y, region_.y + region_.height) - region_.y;
+        if (band_end <= emitted_rows_) {
+            return;
+        }
+        if (image_.Height() != band_end - emitted_rows_) {
+            image_.SetSize(region_.width, band_end - emitted_rows_, image_.Format());
+        }
+    }
+    if (above) {
+        WriteRows(mcu_row, slot, begin - 2, begin);
+    }
+    WriteRows(mcu_row, slot, begin, end);
+    if (below) {
+        WriteRows(mcu_row, slot, end, end + 2);
+    }
+    if (sink_) {
+        (*sink_)(image_, emitted_rows_);
+        emitted_rows_ += image_.Height();
+    }
+}
+
+// Converts the pixel rows [begin, end) of the image within the region, from
+// the samples of |mcu_row| in |slot| and the edges of the MCU rows around it.
+void Reader::WriteRows(size_t mcu_row, size_t slot, size_t begin, size_t end) {
+    begin = std::max(begin, region_.y);
+    end = std::min(end, region_.y + region_.height);
+    if (begin >= end) {
+        return;
+    }
+    PixelFormat format = image_.Format();
+    size_t width = region_.width;
+    // Gray output needs only the luma of color images.
+    size_t channels_cnt = format == PixelFormat::kGray8 ? 1 : scan_.size();
+    // Offset of the region in the sample planes, in output pixels.
+    size_t offset = region_.x - first_col_ * h1_max_ * block_size_;
+    // Components of half the resolution cover sample columns [first, last]
+    // of the region, padded with a sample on both sides when filtered. Other
+    // subsampled ones are replicated into rows of full resolution, from the
+    // sample columns under every pixel. The rows are kept in the buffers of
+    // the slot, 2 * count samples each; see PrepareRowBuffers.
+    size_t first = region_.x / 2;
+    size_t last = (region_.x + width - 1) / 2;
+    size_t count = last - first + 1;
+    auto pad = [&](const ScanComponent& component, const uint8_t* source, uint8_t* output) {
+        source -= first_col_ * component.h1 * component.block_size;
+        output[0] = source[first > 0 ? first - 1 : 0];
+        std::copy(source + first, source + last + 1, output + 1);
+        output[last - first + 2] = source[std::min(last + 1, component.width - 1)];
+    };
+
+    size_t mcu_height = v1_max_ * block_size_;
+    size_t first_row = sink_ ? emitted_rows_ : 0;
+    ColorKernel convert = DefaultColorKernel();
+    for (size_t y = begin - region_.y; y < end - region_.y; ++y) {
+        size_t i = region_.y + y;
+        const uint8_t* samples[3] = {};
+        for (size_t c = 0; c < channels_cnt; ++c) {
+            ScanComponent& component = scan_[c];
+            size_t rows = component.v1 * component.block_size;
+            size_t near = i / mcu_height * rows + i % mcu_height * rows / mcu_height;
+            const uint8_t* source = SampleRow(c, mcu_row, slot, near);
+            // The triangle filter weighs the nearest sample row 3:1 with the
+            // one on the other side of the pixel row, replicated at the edges.
+            const uint8_t* far = nullptr;
+            if (component.fancy_v) {
+                size_t other = i % 2 ? std::min(near + 1, component.height - 1)
+                                     : near - (near > 0);
+                far = SampleRow(c, mcu_row, slot, other);
+            }
+            if (component.upsampled.empty()) {
+                samples[c] = source + offset;
+                continue;
+            }
+            uint8_t* output = component.upsampled.data() + slot * 2 * count;
+            if (component.fancy_h) {
+                uint8_t* padded = component.padded.data() + slot * 2 * (count + 2);
+                pad(component, source, padded);
+                if (far) {
+                    pad(component, far, padded + count + 2);
+                    UpsampleH2V2(padded + 1, padded + count + 3, output, count,
+                                 component.sums.data() + slot * (count + 2));
+                } else {
+                    UpsampleH2V1(padded + 1, output, count);
+                }
+                samples[c] = output + region_.x % 2;
+            } else if (!component.padded.empty()) {
+                size_t origin = first_col_ * component.h1 * component.block_size;
+                UpsampleH2Box(source + first - origin, output, count);
+                samples[c] = output + region_.x % 2;
+            } else if (!component.columns.empty()) {
+                for (size_t x = 0; x < width; ++x) {
+                    output[x] = source[component.columns[x]];
                 }
+                samples[c] = output;
+            } else {
+                UpsampleH1V2(source + offset, far + offset, output, width, i % 2);
+                samples[c] = output;
             }
         }
+        uint8_t* row = image_.Row(y - first_row);
+        if (format == PixelFormat::kGray8 || format == PixelFormat::kYCbCrPlanar) {
+            std::copy(samples[0], samples[0] + width, row);
+            for (size_t c = 1; c < Image::PlaneCount(format); ++c) {
+                uint8_t* plane = image_.Row(y - first_row, c);
+                if (channels_cnt == 1) {
+                    std::fill(plane, plane + width, 128);
+                } else {
+                    std::copy(samples[c], samples[c] + width, plane);
+                }
+            }
+        } else if (channels_cnt == 1) {
+            size_t bytes_per_pixel = Image::BytesPerPixel(format);
+            for (size_t x = 0; x < width; ++x) {
+                uint8_t* p = row + x * bytes_per_pixel;
+                p[0] = p[1] = p[2] = samples[0][x];
+                if (bytes_per_pixel == 4) {
+                    p[3] = 255;
+                }
+            }
+        } else {
+            convert(samples[0], samples[1], samples[2], row, width, format);
+        }
+    }
+}
+
+// Copies the samples of |mcu_row|, kept in |slot|, under the region into the
+// planes of the image as they are, and passes them on to sink_ if there is one.
+void Reader::CopyPlanes(size_t mcu_row, size_t slot) {
+    // Rows of every plane in the MCU row: [first_rows[c], first_rows[c] + sizes[c].height).
+    std::vector<PlaneSize> sizes(3);
+    size_t first_rows[3];
+    for (size_t c = 0; c < 3; ++c) {
+        const ScanComponent& component = scan_[c < scan_.size() ? c : 0];
+        size_t rows = component.v1 * component.block_size;
+        first_rows[c] = std::max(mcu_row * rows, component.plane_y);
+        size_t end = std::min((mcu_row + 1) * rows, component.plane_y + component.plane.height);
+        sizes[c] = component.plane;
+        sizes[c].height = end > first_rows[c] ? end - first_rows[c] : 0;
+        if (first_rows[c] > component.plane_y) {
+            // Rows below the first MCU row of the region start at a sample.
+            sizes[c].y_phase = 0;
+        }
+    }
+    if (sizes[0].height == 0) {
+        return;
+    }
+    bool resize = false;
+    for (size_t c = 0; sink_ && c < 3; ++c) {
+        const PlaneSize& size = image_.GetPlaneSize(c);
+        resize |= size.height != sizes[c].height || size.y_phase != sizes[c].y_phase;
+    }
+    if (resize) {
+        image_.SetSize(sizes, image_.Format());
+    }
+    for (size_t c = 0; c < 3; ++c) {
+        const ScanComponent& component = scan_[c < scan_.size() ? c : 0];
+        size_t rows = component.v1 * component.block_size;
+        size_t y = sink_ ? 0 : first_rows[c] - component.plane_y;
+        const uint8_t* source =
+            component.samples.data() +
+            (slot * rows + first_rows[c] - mcu_row * rows) * component.stride +
+            component.plane_x - first_col_ * component.h1 * component.block_size;
+        for (size_t i = 0; i < sizes[c].height; ++i, source += component.stride) {
+            uint8_t* row = image_.Row(y + i, c);
+            if (c < scan_.size()) {
+                std::copy_n(source, sizes[c].width, row);
+            } else {
+                std::fill_n(row, sizes[c].width, 128);
+            }
+        }
+    }
+    if (sink_) {
+        (*sink_)(image_, first_rows[0] - region_.y);
     }
 }
 
@@ -328,27 +1304,69 @@ size_t Reader::ReadBlockSize() {
     return siz;
 }
 
-RGB Reader::YCbCrToRGB(double y, double cb, double cr) {
-    int r = std::round(y + 1.402 * (cr - 128));
-    int g = std::round(y - 0.34414 * (cb - 128) - 0.71414 * (cr - 128));
-    int b = std::round(y + 1.772 * (cb - 128));
+Image Reader::DecodeRegion(const Region& region) {
+    requested_region_ = region;
+    return DecodeImage();
+}
 
-    r = std::min(std::max(0, r), 255);
-    g = std::min(std::max(0, g), 255);
-    b = std::min(std::max(0, b), 255);
+Image Reader::DecodeImage() {
+    ReadHeaders();
+    if (progressive_) {
+        DecodeProgressive();
+    } else {
+        ReadSOS();
+        ReadEOI();
+    }
+    image_.SetComment(comment_);
+    return std::move(image_);
+}
 
-    return {r, g, b};
+ImageHeader Reader::ProbeHeader() {
+    ReadHeaders();
+    return Header();
 }
 
-Image Reader::DecodeImage() {
+ImageHeader Reader::DecodeRows(const RowSink& sink) {
+    sink_ = &sink;
+    DecodeImage();
+    return Header();
+}
+
+ImageHeader Reader::Header() {
+    ImageHeader header;
+    header.width = width_;
+    header.height = height_;
+    for (size_t c = 0; c < channels_cnt_; ++c) {
+        const Channel& channel = channels_[c];
+        header.components.push_back({channel.id, channel.h1, channel.v1, channel.dqt_idx});
+    }
+    header.restart_interval = restart_interval_;
+    header.progressive = progressive_;
+    header.comment = comment_;
+    return header;
+}
+
+// Reads the markers up to and including the SOS marker of the first scan.
+void Reader::ReadHeaders() {
     ReadSOI();
+    if (ReadSegments() == k_eoi_) {
+        throw std::runtime_error("EOI only in end");
+    }
+    if (!read_sof_) {
+        throw std::runtime_error("No SOF0 content");
+    }
+}
+
+// Reads table and metadata segments up to the next SOS or EOI marker, and
+// returns that marker.
+uint16_t Reader::ReadSegments() {
     while (true) {
         auto marker = ReadMarker();
         if (marker == k_soi_) {
             throw std::runtime_error("SOI only in begin");
         }
-        if (marker == k_eoi_) {
-            throw std::runtime_error("EOI only in end");
+        if (marker == k_sos_ || marker == k_eoi_) {
+            return marker;
         }
         if (marker == k_com_) {
             ReadCOM();
@@ -356,17 +1374,14 @@ Image Reader::DecodeImage() {
             ReadApp();
         } else if (marker == k_dqt_) {
             ReadDQT();
-        } else if (marker == k_sof0_) {
-            ReadSOF0();
+        } else if (marker == k_sof0_ || marker == k_sof2_) {
+            ReadSOF(marker == k_sof2_);
         } else if (marker == k_dht_) {
             ReadDHT();
-        } else if (marker == k_sos_) {
-            ReadSOS();
-            ReadEOI();
-            break;
+        } else if (marker == k_dri_) {
+            ReadDRI();
         } else {
             throw std::runtime_error("Invalid marker");
         }
     }
-    return image_;
 }
\ No newline at end of file
@@ -1,20 +1,78 @@
 #pragma once
+#include "aligned_buffer.h"
 #include "bitreader.h"
 #include <image.h>
-#include <unordered_map>
 #include <unordered_set>
 #include <huffman.h>
+#include <decoder.h>
+#include <array>
+#include "idct.h"
+#include "thread_pool.h"
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <string>
 
 class Reader {
+    // Component of the frame: its id and sampling factors from SOF, and the
+    // ids of its tables, the Huffman ones from the latest SOS including it.
     struct Channel {
-        uint16_t h1;
-        uint16_t v1;
-        size_t dqt_idx;
+        size_t id = 0;
+        uint16_t h1 = 0;
+        uint16_t v1 = 0;
+        size_t dqt_idx = 0;
+        size_t huffman_dc = 0;
+        size_t huffman_ac = 0;
     };
 
-    struct ChannelInfo {
-        size_t huffman_dc;
-        size_t huffman_ac;
+    // Component of the current scan with its tables resolved once per scan,
+    // and its samples, in slots of one MCU row each: a single slot when
+    // decoding sequentially, a ring of them when pipelining, and the whole
+    // image when restart intervals are decoded in parallel.
+    struct ScanComponent {
+        size_t h1;
+        size_t v1;
+        const HuffmanTree* huffman_dc;
+        const HuffmanTree* huffman_ac;
+        const uint16_t* quant;
+        // Side of the decoded blocks, 8 unless the image is scaled down.
+        size_t block_size = 8;
+        // Size of the component in samples, and whether it is upsampled by
+        // the triangle filters of libjpeg horizontally and vertically, rather
+        // than by replicating samples.
+        size_t width = 0;
+        size_t height = 0;
+        bool fancy_h = false;
+        bool fancy_v = false;
+        // Samples of the component under the region, the plane of
+        // kYCbCrSubsampled output.
+        size_t plane_x = 0;
+        size_t plane_y = 0;
+        PlaneSize plane;
+        AlignedVector<uint8_t> samples;
+        size_t stride = 0;
+        // The first and the last sample row of every MCU row of the region,
+        // kept for the rows of the neighbouring MCU rows when fancy_v.
+        AlignedVector<uint8_t> edges;
+        // Rows WriteRows upsamples, one set per slot of samples: two padded
+        // sample rows with the column sums of the filter, and the upsampled
+        // row. Components replicated at other ratios take the sample column
+        // under every pixel from columns.
+        std::vector<uint8_t> padded;
+        std::vector<int16_t> sums;
+        std::vector<uint8_t> upsampled;
+        std::vector<size_t> columns;
+    };
+
+    // Parsed SOS header: the components of the scan as indices into
+    // channels_, and the spectral selection and successive
+    // approximation parameters.
+    struct ScanHeader {
+        std::vector<size_t> components;
+        size_t ss;
+        size_t se;
+        size_t ah;
+        size_t al;
     };
 
     //  0  1  2  3  4  5  6  7
@@ -39,37 +97,152 @@ class Reader {
     const uint16_t k_app_to_ = 0xEF;
     const uint16_t k_dqt_ = 0xDB;
     const uint16_t k_sof0_ = 0xC0;
+    const uint16_t k_sof2_ = 0xC2;
     const uint16_t k_dht_ = 0xC4;
     const uint16_t k_sos_ = 0xDA;
+    const uint16_t k_dri_ = 0xDD;
+    const uint16_t k_rst_from_ = 0xD0;
+    const uint16_t k_rst_to_ = 0xD7;
 
-    const std::unordered_set<uint16_t> k_markers_{k_marker_, k_soi_, k_eoi_,  k_com_, k_app_from_,
-                                                  k_app_to_, k_dqt_, k_sof0_, k_dht_, k_sos_};
+    const std::unordered_set<uint16_t> k_markers_{k_marker_, k_soi_,  k_eoi_, k_com_,
+                                                  k_app_from_, k_app_to_, k_dqt_, k_sof0_,
+                                                  k_sof2_,     k_dht_,    k_sos_, k_dri_};
 
 public:
-    Reader(std::istream& input);
+    Reader(std::istream& input, const DecoderOptions& options = {});
+    // Parses |data| in place; it must outlive the reader.
+    Reader(std::span<const uint8_t> data, const DecoderOptions& options = {});
+    // Without input until Reset.
+    explicit Reader(const DecoderOptions& options);
+    // Starts over on new input, keeping the storage of the tables and the
+    // buffers of the previous image, see DecoderContext.
+    void Reset(std::istream& input);
+    void Reset(std::span<const uint8_t> data);
     Image DecodeImage();
+    // Decodes only |region| of the image, see ::DecodeRegion.
+    Image DecodeRegion(const Region& region);
+    // Parses the markers before the scan only, see ::ProbeHeader.
+    ImageHeader ProbeHeader();
+    // Decodes the image into |sink| one MCU row at a time, see ::DecodeRows.
+    ImageHeader DecodeRows(const RowSink& sink);
 
 private:
+    void CheckOptions();
+    void ResetState();
+    ImageHeader Header();
+    void ReadHeaders();
+    uint16_t ReadSegments();
     uint16_t ReadMarker();
     void ReadSOI();
     void ReadEOI();
     void ReadCOM();
     void ReadApp();
     void ReadDQT();
-    void ReadSOF0();
+    void ReadSOF(bool progressive);
     void ReadDHT();
+    const HuffmanTree* FindHuffman(size_t coefs_class, size_t idx) const;
+    void ReadDRI();
+    void PrepareImage();
+    void PrepareFrame();
+    ScanHeader ReadScanHeader();
     void ReadSOS();
+    void PrepareComponents(size_t sample_slots);
+    void PrepareRowBuffers(size_t c, size_t sample_slots);
+    void PrepareScan(size_t sample_slots, size_t coefficient_slots);
+    bool InRegion(size_t mcu) const;
+    void SkipIntervals();
+    void FinishScan();
+    void DecodeMcuRow(size_t slot);
+    template <size_t kComponents, size_t kLumaBlocks>
+    void DecodeMcus(BitReader& bit_reader, int* prev_dc, int16_t* blocks, size_t mcus) const;
+    void ReadRestart();
+    void DecodeIntervals();
+    void DecodePipelined();
+    void DecodeInterval(InverseDct& idct, AlignedVector<int16_t>& blocks, const uint8_t* data,
+                        size_t size, size_t first_mcu, size_t mcus_cnt);
+    void DecodeBlock(BitReader& bit_reader, const ScanComponent& component, int& prev_dc,
+                     int16_t* block) const;
+    void TransformMcuRow(InverseDct& idct, size_t slot);
+    void DecodeProgressive();
+    void DecodeProgressiveScan(const ScanHeader& header);
+    void DecodeDcFirst(const HuffmanTree& huffman, int& prev_dc, int16_t* block, size_t al);
+    void DecodeDcRefine(int16_t* block, size_t al);
+    void DecodeAcFirst(const HuffmanTree& huffman, int16_t* block, size_t ss, size_t se,
+                       size_t al);
+    void DecodeAcRefine(const HuffmanTree& huffman, int16_t* block, size_t ss, size_t se,
+                        size_t al);
+    void TransformProgressive();
+    void SaveEdges(size_t mcu_row, size_t slot);
+    const uint8_t* SampleRow(size_t c, size_t mcu_row, size_t slot, size_t row) const;
+    void WriteMcuRow(size_t mcu_row, size_t slot);
+    void WriteRows(size_t mcu_row, size_t slot, size_t begin, size_t end);
+    void CopyPlanes(size_t mcu_row, size_t slot);
+    ThreadPool& Pool();
     size_t ReadBlockSize();
-    RGB YCbCrToRGB(double y, double cb, double cr);
 
     BitReader bit_reader_;
-    std::unordered_map<size_t, std::vector<std::vector<int>>> dqt_;
-    std::unordered_map<size_t, Channel> channels_;
-    std::unordered_map<size_t, ChannelInfo> channels_info_;
-    std::unordered_map<size_t, HuffmanTree> huffmans_[2];
-    bool read_sof0_ = false;
+    DecoderOptions options_;
+    // Quantization tables in natural order, and Huffman tables for DC and
+    // AC, by table id. Trees are built in place, reusing their storage.
+    std::array<std::optional<std::array<uint16_t, 64>>, 4> dqt_;
+    std::array<HuffmanTree, 4> huffmans_[2];
+    std::array<bool, 4> huffman_defined_[2] = {};
+    bool read_sof_ = false;
+    bool progressive_ = false;
+    std::string comment_;
+    // The decoded region, or only its rows of the current MCU row when
+    // they are passed on to sink_.
     Image image_;
+    const RowSink* sink_ = nullptr;
+    // Size of the image before scaling, and the side of a decoded block.
+    size_t width_ = 0;
+    size_t height_ = 0;
+    size_t block_size_ = 8;
+    // Components in the order of SOF; the frame has one or three.
+    std::array<Channel, 4> channels_;
+    size_t channels_cnt_ = 0;
+    // Part of the (scaled) image to decode, clipped to it.
+    std::optional<Region> requested_region_;
+    Region region_;
     uint16_t h1_max_ = 0;
     uint16_t v1_max_ = 0;
-    std::unordered_map<size_t, int> prev_dc_val_;
+    size_t restart_interval_ = 0;
+
+    // Per-scan state. Buffers are sized once in PrepareScan and reused for
+    // every MCU row: coefficients in natural order, MCU after MCU, with the
+    // blocks of each MCU in scan order, one slot per MCU row like the samples
+    // in scan_.
+    std::vector<ScanComponent> scan_;
+    size_t mcus_w_ = 0;
+    size_t mcus_h_ = 0;
+    // MCUs covering the region, and those next to it that the triangle
+    // filters read: rows [first_row_, last_row_) and columns
+    // [first_col_, last_col_).
+    size_t first_row_ = 0;
+    size_t last_row_ = 0;
+    size_t first_col_ = 0;
+    size_t last_col_ = 0;
+    // Some component is upsampled vertically by the triangle filter, so the
+    // first and the last pixel row of an MCU row also need the samples of
+    // the neighbouring MCU row. Such a seam between MCU rows k and k + 1 of
+    // the region is converted by the second of them to arrive, counted in
+    // seams_[k - first_row_]. Rows up to emitted_rows_ went to sink_.
+    bool fancy_v_ = false;
+    std::unique_ptr<std::atomic<uint8_t>[]> seams_;
+    size_t emitted_rows_ = 0;
+    size_t blocks_per_mcu_ = 0;
+    // Decodes MCUs of the layout of the scan, picked in PrepareScan.
+    void (Reader::*decode_mcus_)(BitReader& bit_reader, int* prev_dc, int16_t* blocks,
+                                 size_t mcus) const = nullptr;
+    AlignedVector<int16_t> coefficients_;
+    std::array<int, 4> prev_dc_ = {};
+    size_t mcus_decoded_ = 0;
+    size_t restarts_ = 0;
+    // Progressive images are decoded in full before any transform: per
+    // component, the coefficients of every block of the MCU grid in natural
+    // order, row after row of blocks. eobrun_ counts the blocks of the
+    // current AC scan still to skip after an end-of-band run.
+    std::vector<AlignedVector<int16_t>> progressive_coefficients_;
+    size_t eobrun_ = 0;
+    std::unique_ptr<ThreadPool> pool_;
 };
\ No newline at end of file
@@ -2,8 +2,35 @@ add_library(decoder_baseline
 
         # maybe your files here
         bitreader.cpp
+        color.cpp
         decoder.cpp
+        decoder_context.cpp
         fft.cpp
         huffman.cpp
+        idct.cpp
+        mapped_file.cpp
+        push_decoder.cpp
         reader.cpp
+        thread_pool.cpp
+        upsample.cpp
 )
+
+# The upsampling filters are left to the vectorizer, whose cost model at -O2
+# in GCC is too cheap for their interleaved stores.
+if (CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+    set_source_files_properties(upsample.cpp PROPERTIES COMPILE_OPTIONS "-fvect-cost-model=dynamic")
+endif ()
+
+# Vector IDCT kernels, picked at runtime according to cpuid.
+if (CMAKE_SYSTEM_PROCESSOR MATCHES "^(x86_64|AMD64|i[3-6]86)$"
+        AND CMAKE_CXX_COMPILER_ID MATCHES "GNU|Clang")
+    target_sources(decoder_baseline PRIVATE
+            idct_sse2.cpp
+            idct_avx2.cpp
+            color_sse2.cpp
+            color_avx2.cpp
+    )
+    set_source_files_properties(idct_sse2.cpp color_sse2.cpp PROPERTIES COMPILE_OPTIONS "-msse2")
+    set_source_files_properties(idct_avx2.cpp color_avx2.cpp PROPERTIES COMPILE_OPTIONS "-mavx2")
+    target_compile_definitions(decoder_baseline PRIVATE DECODER_X86_SIMD)
+endif ()
@@ -2,7 +2,12 @@
 
 #include <catch.hpp>
 
+#include <push_decoder.h>
+
+#include <fstream>
+#include <iterator>
 #include <string>
+#include <vector>
 
 
 // TEST_CASE("google", "[jpg]") {
@@ -61,6 +66,185 @@ TEST_CASE("witch", "[jpg]") {
     CheckImage("witch.jpg");
 }
 
+TEST_CASE("fftw idct (4:2:0)", "[jpg]") {
+    CheckImage("test.jpg", DecoderOptions{.idct = IdctMethod::kFftw});
+}
+
+TEST_CASE("rgba output (4:2:2)", "[jpg]") {
+    CheckImage("chroma_halfed.jpg", DecoderOptions{.format = PixelFormat::kRGBA8888});
+}
+
+TEST_CASE("bgra output (4:2:0)", "[jpg]") {
+    CheckImage("test.jpg", DecoderOptions{.format = PixelFormat::kBGRA8888});
+    CheckImage("grayscale.jpg", DecoderOptions{.format = PixelFormat::kBGRA8888});
+}
+
+TEST_CASE("gray output (grayscale)", "[jpg]") {
+    CheckImage("grayscale.jpg", DecoderOptions{.format = PixelFormat::kGray8});
+}
+
+TEST_CASE("planar ycbcr output (4:2:0)", "[jpg]") {
+    CheckImage("small.jpg", DecoderOptions{.format = PixelFormat::kYCbCrPlanar}, ":)");
+}
+
+TEST_CASE("subsampled planes", "[jpg]") {
+    CheckImage("test.jpg", DecoderOptions{.format = PixelFormat::kYCbCrSubsampled});
+    CheckPlanes("test.jpg", {.width = 1000, .height = 1000});
+    CheckPlanes("test.jpg", {.x = 31, .y = 47, .width = 40, .height = 20});
+    CheckPlanes("chroma_halfed.jpg", {.x = 5, .y = 3, .width = 101, .height = 77}, {.threads = 4});
+    CheckPlanes("progressive-2.jpg", {.x = 10, .y = 20, .width = 300, .height = 300});
+    CheckPlanes("grayscale.jpg", {.width = 100, .height = 100});
+    CheckRows("small.jpg", {.format = PixelFormat::kYCbCrSubsampled}, ":)");
+    CheckRows("restart.jpg", {.format = PixelFormat::kYCbCrSubsampled});
+}
+
+TEST_CASE("restart markers", "[jpg]") {
+    CheckImage("restart.jpg");
+}
+
+TEST_CASE("restart intervals in parallel", "[jpg]") {
+    CheckImage("restart.jpg", DecoderOptions{.threads = 4});
+}
+
+TEST_CASE("pipelined decoding (4:2:0)", "[jpg]") {
+    CheckImage("test.jpg", DecoderOptions{.threads = 4});
+}
+
+TEST_CASE("decode from memory", "[jpg]") {
+    CheckImageFromMemory("small.jpg", ":)");
+    CheckImageFromMemory("restart.jpg");
+}
+
+TEST_CASE("decode mapped file", "[jpg]") {
+    CheckMappedImage("lenna.jpg");
+}
+
+TEST_CASE("scaled decoding", "[jpg]") {
+    for (size_t scale : {2, 4, 8}) {
+        CheckImage("test.jpg", DecoderOptions{.scale = scale});
+        CheckImage("chroma_halfed.jpg", DecoderOptions{.scale = scale});
+        CheckImage("grayscale.jpg", DecoderOptions{.scale = scale});
+    }
+    CheckImage("restart.jpg", DecoderOptions{.threads = 4, .scale = 8});
+}
+
+TEST_CASE("region decoding", "[jpg]") {
+    CheckRegion("lenna.jpg", {.x = 100, .y = 150, .width = 200, .height = 120});
+    CheckRegion("test.jpg", {.x = 37, .y = 201, .width = 1000, .height = 1000});
+    CheckRegion("chroma_halfed.jpg", {.x = 500, .y = 0, .width = 17, .height = 600});
+    CheckRegion("test.jpg", {.x = 10, .y = 20, .width = 50, .height = 60}, {.scale = 2});
+    CheckRegion("restart.jpg", {.x = 131, .y = 250, .width = 100, .height = 100});
+    CheckRegion("restart.jpg", {.x = 0, .y = 100, .width = 40, .height = 100}, {.threads = 4});
+    CheckRegion("lenna.jpg", {.x = 0, .y = 300, .width = 512, .height = 100}, {.threads = 4});
+}
+
+TEST_CASE("fancy upsampling", "[jpg]") {
+    CheckRegion("test.jpg", {.x = 31, .y = 47, .width = 150, .height = 99}, {.threads = 4});
+    CheckRegion("chroma_halfed.jpg", {.x = 1, .y = 1, .width = 1398, .height = 8});
+    CheckRows("test.jpg");
+    CheckRows("progressive-2.jpg", {.format = PixelFormat::kRGBA8888}, "such decoder");
+}
+
+TEST_CASE("box upsampling", "[jpg]") {
+    CheckImage("test.jpg", DecoderOptions{.upsampling = Upsampling::kBox});
+    CheckImage("chroma_halfed.jpg", DecoderOptions{.threads = 4, .upsampling = Upsampling::kBox});
+    CheckRegion("small.jpg", {.x = 3, .y = 5, .width = 20, .height = 20},
+                {.upsampling = Upsampling::kBox});
+}
+
+TEST_CASE("progressive", "[jpg]") {
+    CheckImage("progressive.jpg");
+    CheckImage("progressive-2.jpg", "such decoder");
+    CheckImage("progressive_small.jpg");
+}
+
+TEST_CASE("progressive with options", "[jpg]") {
+    CheckImage("progressive.jpg", DecoderOptions{.threads = 4});
+    CheckImage("progressive-2.jpg", DecoderOptions{.scale = 4}, "such decoder");
+    CheckRegion("progressive.jpg", {.x = 30, .y = 40, .width = 100, .height = 70});
+}
+
+TEST_CASE("progressive previews", "[jpg]") {
+    size_t previews = 0;
+    DecoderOptions options;
+    options.progressive_preview = [&](const Image& preview, size_t scans) {
+        REQUIRE(scans == ++previews);
+        REQUIRE(preview.Width() == 420);
+        REQUIRE(preview.Height() == 450);
+        return true;
+    };
+    CheckImage("progressive.jpg", options);
+    REQUIRE(previews > 1);
+
+    options.progressive_preview = [](const Image&, size_t) { return false; };
+    std::ifstream fin(std::string(HSE_TASK_DIR) + "tests/progressive.jpg");
+    auto image = Decode(fin, options);
+    REQUIRE(image.Width() == 420);
+    REQUIRE(image.Height() == 450);
+}
+
+TEST_CASE("decode by rows", "[jpg]") {
+    CheckRows("small.jpg", {}, ":)");
+    CheckRows("restart.jpg", {.threads = 4});
+    CheckRows("chroma_halfed.jpg", {.format = PixelFormat::kYCbCrPlanar, .scale = 2});
+    CheckRows("progressive.jpg");
+}
+
+TEST_CASE("push decoding", "[jpg]") {
+    CheckPushed("small.jpg", 1, ":)");
+    CheckPushed("restart.jpg", 777);
+    CheckPushed("progressive.jpg", 4096);
+
+    std::ifstream fin(std::string(HSE_TASK_DIR) + "tests/lenna.jpg", std::ios::binary);
+    std::vector<uint8_t> data(std::istreambuf_iterator<char>(fin), {});
+    PushDecoder decoder;
+    decoder.Feed(std::span<const uint8_t>(data).first(data.size() / 2));
+    REQUIRE_THROWS(decoder.Finish());
+}
+
+TEST_CASE("batch decoding", "[jpg]") {
+    CheckBatch({{"small.jpg", ":)"},
+                {"lenna.jpg", ""},
+                {"bad/bad3.jpg", ""},
+                {"progressive.jpg", ""},
+                {"grayscale.jpg", ""},
+                {"restart.jpg", ""},
+                {"bad/bad10.jpg", ""},
+                {"tiny.jpg", ""}},
+               {.threads = 4});
+    CheckBatch({}, {.threads = 4});
+}
+
+TEST_CASE("reused decoder context", "[jpg]") {
+    CheckContext({{"lenna.jpg", ""},
+                  {"small.jpg", ":)"},
+                  {"bad/bad3.jpg", ""},
+                  {"progressive.jpg", ""},
+                  {"grayscale.jpg", ""},
+                  {"bad/bad10.jpg", ""},
+                  {"test.jpg", ""},
+                  {"restart.jpg", ""}});
+    CheckContext(
+        {{"restart.jpg", ""}, {"progressive-2.jpg", "such decoder"}, {"chroma_halfed.jpg", ""}},
+        {.threads = 4, .scale = 2});
+}
+
+TEST_CASE("probe header", "[jpg]") {
+    CheckHeader("small.jpg", ":)");
+    CheckHeader("lenna.jpg");
+    CheckHeader("grayscale.jpg");
+    CheckHeader("restart.jpg");
+    CheckHeader("progressive.jpg");
+
+    std::ifstream fin(std::string(HSE_TASK_DIR) + "tests/chroma_halfed.jpg");
+    auto header = ProbeHeader(fin);
+    REQUIRE(header.components.size() == 3);
+    REQUIRE(header.components[0].h_sampling == 2);
+    REQUIRE(header.components[0].v_sampling == 1);
+    REQUIRE(header.components[1].h_sampling == 1);
+    REQUIRE(header.components[1].v_sampling == 1);
+}
+
 TEST_CASE("Error handling", "[jpg]") {
     const size_t tests_count = 24;
     for (size_t i = 1; i <= tests_count; ++i) {
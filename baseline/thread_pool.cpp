@@ -0,0 +1,101 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers_.reserve(threads - 1);
+    for (size_t i = 1; i < threads; ++i) {
+        workers_.emplace_back([this] { WorkerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::Size() const {
+    return workers_.size() + 1;
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& task) {
+    std::atomic<size_t> next = 0;
+    std::exception_ptr error;
+    size_t helpers = std::min(workers_.size(), count > 0 ? count - 1 : 0);
+    size_t running = helpers;
+
+    auto run = [&] {
+        for (size_t i; (i = next++) < count;) {
+            try {
+                task(i);
+            } catch (...) {
+                std::lock_guard lock(mutex_);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                next = count;
+            }
+        }
+    };
+
+    for (size_t i = 0; i < helpers; ++i) {
+        Submit([&] {
+            run();
+            std::lock_guard lock(mutex_);
+            --running;
+            cv_.notify_all();
+        });
+    }
+    run();
+
+    std::unique_lock lock(mutex_);
+    while (running > 0) {
+        if (!RunQueued(lock)) {
+            cv_.wait(lock);
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::Submit(std::function<void()> job) {
+    {
+        std::lock_guard lock(mutex_);
+        queue_.push_back(std::move(job));
+    }
+    cv_.notify_one();
+}
+
+// Runs one queued job with |lock| released, returns false if there is none.
+bool ThreadPool::RunQueued(std::unique_lock<std::mutex>& lock) {
+    if (queue_.empty()) {
+        return false;
+    }
+    auto job = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    job();
+    lock.lock();
+    return true;
+}
+
+void ThreadPool::WorkerLoop() {
+    std::unique_lock lock(mutex_);
+    while (!stop_) {
+        if (!RunQueued(lock)) {
+            cv_.wait(lock);
+        }
+    }
+}
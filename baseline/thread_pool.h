@@ -0,0 +1,42 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running index ranges in parallel.
+class ThreadPool {
+public:
+    // Starts |threads| - 1 workers, the thread calling ParallelFor takes part
+    // in the work as well. 0 means one thread per hardware thread.
+    explicit ThreadPool(size_t threads);
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool();
+
+    size_t Size() const;
+
+    // Calls task(i) for every i in [0, count) and returns when all calls have
+    // finished. Indices are handed out one at a time, so uneven tasks balance
+    // out. The first exception thrown by a task is rethrown here and the
+    // remaining indices are skipped. Safe to call from inside a task: a
+    // waiting caller runs queued work instead of blocking a worker.
+    void ParallelFor(size_t count, const std::function<void(size_t)>& task);
+
+private:
+    void Submit(std::function<void()> job);
+    bool RunQueued(std::unique_lock<std::mutex>& lock);
+    void WorkerLoop();
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> queue_;
+    bool stop_ = false;
+};
@@ -0,0 +1,37 @@
+#include "upsample.h"
+
+void UpsampleH2V1(const uint8_t* input, uint8_t* output, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        int value = input[i] * 3;
+        output[2 * i] = (value + input[i - 1] + 1) >> 2;
+        output[2 * i + 1] = (value + input[i + 1] + 2) >> 2;
+    }
+}
+
+void UpsampleH2V2(const uint8_t* near, const uint8_t* far, uint8_t* output, size_t count,
+                  int16_t* sums) {
+    // Column sums of the vertical filter, kept unrounded.
+    for (size_t i = 0; i < count + 2; ++i) {
+        sums[i] = near[i - 1] * 3 + far[i - 1];
+    }
+    const int16_t* sum = sums + 1;
+    for (size_t i = 0; i < count; ++i) {
+        int value = sum[i] * 3;
+        output[2 * i] = (value + sum[i - 1] + 8) >> 4;
+        output[2 * i + 1] = (value + sum[i + 1] + 7) >> 4;
+    }
+}
+
+void UpsampleH1V2(const uint8_t* near, const uint8_t* far, uint8_t* output, size_t count,
+                  bool lower) {
+    int bias = lower ? 2 : 1;
+    for (size_t i = 0; i < count; ++i) {
+        output[i] = (near[i] * 3 + far[i] + bias) >> 2;
+    }
+}
+
+void UpsampleH2Box(const uint8_t* input, uint8_t* output, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        output[2 * i] = output[2 * i + 1] = input[i];
+    }
+}
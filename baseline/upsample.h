@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Triangle filters of libjpeg's fancy upsampling, producing the same samples.
+// Inputs hold |count| samples and one more on each side, at [-1] and
+// [count], which replicate the edge samples at the borders of the image.
+// Whole rows are filtered at once; the loops have no dependencies between
+// iterations, so the compiler vectorizes them.
+
+// Doubles a row horizontally into 2 * |count| samples.
+void UpsampleH2V1(const uint8_t* input, uint8_t* output, size_t count);
+
+// Doubles a row both ways: |near| is the row of the component closest to the
+// output row and |far| the one on its other side. |sums| is scratch space for
+// |count| + 2 values.
+void UpsampleH2V2(const uint8_t* near, const uint8_t* far, uint8_t* output, size_t count,
+                  int16_t* sums);
+
+// Doubles a row vertically only. |lower| tells that |far| is the row below.
+void UpsampleH1V2(const uint8_t* near, const uint8_t* far, uint8_t* output, size_t count,
+                  bool lower);
+
+// Doubles a row horizontally by repeating every sample, without the filter;
+// |input| needs no padding.
+void UpsampleH2Box(const uint8_t* input, uint8_t* output, size_t count);
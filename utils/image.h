@@ -1,7 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <vector>
 #include <cstddef>
+#include <cstdint>
 #include <string>
 #include <stdexcept>
 
@@ -9,44 +12,182 @@ struct RGB {
     int r, g, b;
 };
 
+enum class PixelFormat {
+    // Interleaved 8-bit samples, one plane.
+    kRGB888,
+    kRGBA8888,
+    kBGRA8888,
+    kGray8,
+    // Three 8-bit planes: Y, Cb and Cr.
+    kYCbCrPlanar,
+    // The same planes, each at the resolution of its component: chroma stays
+    // subsampled as it was coded.
+    kYCbCrSubsampled,
+};
+
+struct PlaneSize {
+    size_t width = 0;
+    size_t height = 0;
+    // Pixels of the image per sample of the plane, for GetPixel and SetPixel.
+    size_t h_subsampling = 1;
+    size_t v_subsampling = 1;
+    // Position of the first pixel within its sample, for planes which start
+    // in the middle of one.
+    size_t x_phase = 0;
+    size_t y_phase = 0;
+};
+
+// Pixels are kept in one contiguous buffer. Each plane starts at its own
+// offset in it and has its own row stride in bytes; consumers can take whole
+// rows through Row() instead of going pixel by pixel.
 class Image {
 public:
     Image() {
     }
-    Image(size_t width, size_t height) {
-        SetSize(width, height);
+    Image(size_t width, size_t height, PixelFormat format = PixelFormat::kRGB888) {
+        SetSize(width, height, format);
     }
 
-    void SetSize(size_t width, size_t height) {
+    // |stride| is the minimal distance between rows of the first plane in
+    // bytes; 0 means rows are packed.
+    void SetSize(size_t width, size_t height, PixelFormat format = PixelFormat::kRGB888,
+                 size_t stride = 0) {
+        SetSize(std::vector<PlaneSize>(PlaneCount(format), {.width = width, .height = height}),
+                format, stride);
+    }
+
+    // Planes of their own sizes, as kYCbCrSubsampled has them; the first one
+    // is the size of the image.
+    void SetSize(const std::vector<PlaneSize>& sizes, PixelFormat format, size_t stride = 0) {
+        width_ = sizes[0].width;
+        height_ = sizes[0].height;
+        format_ = format;
+        planes_.assign(sizes.size(), {});
+        size_t size = 0;
+        for (size_t i = 0; i < planes_.size(); ++i) {
+            Plane& plane = planes_[i];
+            plane.size = sizes[i];
+            plane.offset = size;
+            plane.stride = std::max(stride, plane.size.width * BytesPerPixel(format));
+            size += plane.stride * plane.size.height;
+        }
 #ifdef MAX_ALLOWED_IMAGE_SIZE_BYTES
-        if (width * height * sizeof(RGB) > MAX_ALLOWED_IMAGE_SIZE_BYTES) {
+        if (size > MAX_ALLOWED_IMAGE_SIZE_BYTES) {
             throw std::invalid_argument("Too big image");
         }
 #endif
-        data_.assign(height, std::vector<RGB>(width));
+        data_.assign(size, 0);
+    }
+
+    // Size of the image, or of one of its planes.
+    size_t Width(size_t plane = 0) const {
+        return plane ? planes_[plane].size.width : width_;
+    }
+
+    size_t Height(size_t plane = 0) const {
+        return plane ? planes_[plane].size.height : height_;
+    }
+
+    const PlaneSize& GetPlaneSize(size_t plane) const {
+        return planes_[plane].size;
+    }
+
+    PixelFormat Format() const {
+        return format_;
+    }
+
+    static size_t PlaneCount(PixelFormat format) {
+        return format == PixelFormat::kYCbCrPlanar || format == PixelFormat::kYCbCrSubsampled
+                   ? 3
+                   : 1;
     }
 
-    size_t Width() const {
-        if (data_.empty()) {
-            return 0;
+    // Bytes taken by one pixel within a plane.
+    static size_t BytesPerPixel(PixelFormat format) {
+        switch (format) {
+            case PixelFormat::kRGB888:
+                return 3;
+            case PixelFormat::kRGBA8888:
+            case PixelFormat::kBGRA8888:
+                return 4;
+            default:
+                return 1;
         }
-        return data_[0].size();
     }
 
-    size_t Height() const {
-        return data_.size();
+    size_t Stride(size_t plane = 0) const {
+        return planes_[plane].stride;
     }
 
-    void SetPixel(int y, int x, const RGB& pixel) {
-        data_[y][x] = pixel;
+    uint8_t* Row(size_t y, size_t plane = 0) {
+        return data_.data() + planes_[plane].offset + y * planes_[plane].stride;
     }
 
-    RGB GetPixel(int y, int x) const {
-        return data_[y][x];
+    const uint8_t* Row(size_t y, size_t plane = 0) const {
+        return data_.data() + planes_[plane].offset + y * planes_[plane].stride;
+    }
+
+    void SetPixel(int y, int x, const RGB& pixel) {
+        uint8_t* row = Row(y);
+        switch (format_) {
+            case PixelFormat::kRGB888:
+            case PixelFormat::kRGBA8888: {
+                uint8_t* p = row + x * BytesPerPixel(format_);
+                p[0] = Clamp(pixel.r);
+                p[1] = Clamp(pixel.g);
+                p[2] = Clamp(pixel.b);
+                if (format_ == PixelFormat::kRGBA8888) {
+                    p[3] = 255;
+                }
+                break;
+            }
+            case PixelFormat::kBGRA8888: {
+                uint8_t* p = row + x * 4;
+                p[0] = Clamp(pixel.b);
+                p[1] = Clamp(pixel.g);
+                p[2] = Clamp(pixel.r);
+                p[3] = 255;
+                break;
+            }
+            case PixelFormat::kGray8:
+                row[x] = Clamp(std::round(0.299 * pixel.r + 0.587 * pixel.g + 0.114 * pixel.b));
+                break;
+            case PixelFormat::kYCbCrPlanar:
+            case PixelFormat::kYCbCrSubsampled:
+                row[x] = Clamp(std::round(0.299 * pixel.r + 0.587 * pixel.g + 0.114 * pixel.b));
+                *Sample(1, y, x) = Clamp(
+                    std::round(128 - 0.168736 * pixel.r - 0.331264 * pixel.g + 0.5 * pixel.b));
+                *Sample(2, y, x) = Clamp(
+                    std::round(128 + 0.5 * pixel.r - 0.418688 * pixel.g - 0.081312 * pixel.b));
+                break;
+        }
     }
 
-    RGB& GetPixel(int y, int x) {
-        return data_[y][x];
+    RGB GetPixel(int y, int x) const {
+        const uint8_t* row = Row(y);
+        switch (format_) {
+            case PixelFormat::kRGB888:
+            case PixelFormat::kRGBA8888: {
+                const uint8_t* p = row + x * BytesPerPixel(format_);
+                return {p[0], p[1], p[2]};
+            }
+            case PixelFormat::kBGRA8888: {
+                const uint8_t* p = row + x * 4;
+                return {p[2], p[1], p[0]};
+            }
+            case PixelFormat::kGray8:
+                return {row[x], row[x], row[x]};
+            case PixelFormat::kYCbCrPlanar:
+            case PixelFormat::kYCbCrSubsampled: {
+                double luma = row[x];
+                double cb = *Sample(1, y, x) - 128.0;
+                double cr = *Sample(2, y, x) - 128.0;
+                return {Clamp(std::round(luma + 1.402 * cr)),
+                        Clamp(std::round(luma - 0.34414 * cb - 0.71414 * cr)),
+                        Clamp(std::round(luma + 1.772 * cb))};
+            }
+        }
+        return {};
     }
 
     void SetComment(const std::string& comment) {
@@ -58,6 +199,33 @@ public:
     }
 
 private:
-    std::vector<std::vector<RGB>> data_;
+    struct Plane {
+        PlaneSize size;
+        size_t offset = 0;
+        size_t stride = 0;
+    };
+
+    // Sample of |plane| under the pixel.
+    uint8_t* Sample(size_t plane, size_t y, size_t x) {
+        const PlaneSize& size = planes_[plane].size;
+        return Row((y + size.y_phase) / size.v_subsampling, plane) +
+               (x + size.x_phase) / size.h_subsampling;
+    }
+
+    const uint8_t* Sample(size_t plane, size_t y, size_t x) const {
+        const PlaneSize& size = planes_[plane].size;
+        return Row((y + size.y_phase) / size.v_subsampling, plane) +
+               (x + size.x_phase) / size.h_subsampling;
+    }
+
+    static uint8_t Clamp(double value) {
+        return std::min(std::max(value, 0.0), 255.0);
+    }
+
+    size_t width_ = 0;
+    size_t height_ = 0;
+    PixelFormat format_ = PixelFormat::kRGB888;
+    std::vector<Plane> planes_;
+    std::vector<uint8_t> data_;
     std::string comment_;
 };
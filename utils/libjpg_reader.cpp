@@ -5,7 +5,7 @@
 #include <cstdio>
 #include <stdexcept>
 
-Image ReadJpg(const std::string& filename) {
+Image ReadJpg(const std::string& filename, size_t scale) {
     struct jpeg_decompress_struct cinfo;
     struct jpeg_error_mgr err;
     FILE* infile = fopen(filename.c_str(), "rb");
@@ -19,6 +19,8 @@ Image ReadJpg(const std::string& filename) {
     jpeg_stdio_src(&cinfo, infile);
 
     (void)jpeg_read_header(&cinfo, static_cast<boolean>(true));
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scale;
     (void)jpeg_start_decompress(&cinfo);
 
     int row_stride = cinfo.output_width * cinfo.output_components;
@@ -4,4 +4,5 @@
 
 #include "image.h"
 
-Image ReadJpg(const std::string& filename);
+// |scale| is the libjpeg scale denominator: 1, 2, 4 or 8.
+Image ReadJpg(const std::string& filename, size_t scale = 1);
@@ -2,6 +2,8 @@
 
 #include <catch.hpp>
 #include <decoder.h>
+#include <decoder_context.h>
+#include <push_decoder.h>
 
 #include "image.h"
 #include "png_encoder.hpp"
@@ -12,6 +14,8 @@
 #include <iostream>
 #include <fstream>
 #include <optional>
+#include <iterator>
+#include <vector>
 
 int artifact_index = 0;
 #ifdef HSE_ARTIFACTS_DIR
@@ -60,13 +64,19 @@ void Compare(const Image& actual, const Image& expected) {
 
 void CheckImage(const std::string& filename, const std::string& expected_comment,
                 std::optional<std::string> output_filename) {
-    std::cerr << "Running " << filename << "\n";
-    std::ifstream fin(kBasePath + "tests/" + filename);
+    CheckImage(filename, DecoderOptions{}, expected_comment, output_filename);
+}
+
+std::vector<uint8_t> ReadFile(const std::string& path) {
+    std::ifstream fin(path, std::ios::binary);
     if (!fin.is_open()) {
         throw std::invalid_argument("Cannot open a file");
     }
-    auto image = Decode(fin);
-    fin.close();
+    return {std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>()};
+}
+
+void CheckDecoded(const std::string& filename, const Image& image, size_t scale,
+                  const std::string& expected_comment, std::optional<std::string> output_filename) {
     REQUIRE(image.GetComment() == expected_comment);
     if (output_filename.has_value() && kArtifactsDir.empty()) {
         std::cerr << output_filename.value() << std::endl;
@@ -75,10 +85,244 @@ void CheckImage(const std::string& filename, const std::string& expected_comment
     if (!kArtifactsDir.empty()) {
         WritePng(kArtifactsDir + "/" + std::to_string(artifact_index++) + ".png", image);
     }
-    auto ok_image = ReadJpg(kBasePath + "tests/" + filename);
+    auto ok_image = ReadJpg(kBasePath + "tests/" + filename, scale);
+    Compare(image, ok_image);
+}
+
+void CheckImage(const std::string& filename, const DecoderOptions& options,
+                const std::string& expected_comment, std::optional<std::string> output_filename) {
+    std::cerr << "Running " << filename << "\n";
+    std::ifstream fin(kBasePath + "tests/" + filename);
+    if (!fin.is_open()) {
+        throw std::invalid_argument("Cannot open a file");
+    }
+    auto image = Decode(fin, options);
+    fin.close();
+    CheckDecoded(filename, image, options.scale, expected_comment, output_filename);
+}
+
+void CheckImageFromMemory(const std::string& filename, const std::string& expected_comment) {
+    std::cerr << "Running " << filename << " from memory\n";
+    auto data = ReadFile(kBasePath + "tests/" + filename);
+    CheckDecoded(filename, Decode(std::span<const uint8_t>(data)), 1, expected_comment,
+                 std::nullopt);
+}
+
+void CheckMappedImage(const std::string& filename, const std::string& expected_comment) {
+    std::cerr << "Running mapped " << filename << "\n";
+    CheckDecoded(filename, DecodeFile(kBasePath + "tests/" + filename), 1, expected_comment,
+                 std::nullopt);
+}
+
+void CheckRegion(const std::string& filename, const Region& region,
+                 const DecoderOptions& options) {
+    std::cerr << "Running " << filename << " region " << region.x << "," << region.y << " "
+              << region.width << "x" << region.height << "\n";
+    auto data = ReadFile(kBasePath + "tests/" + filename);
+    auto image = DecodeRegion(std::span<const uint8_t>(data), region, options);
+    auto full_image = ReadJpg(kBasePath + "tests/" + filename, options.scale);
+    Image ok_image(std::min(region.width, full_image.Width() - region.x),
+                   std::min(region.height, full_image.Height() - region.y));
+    for (size_t y = 0; y < ok_image.Height(); ++y) {
+        for (size_t x = 0; x < ok_image.Width(); ++x) {
+            ok_image.SetPixel(y, x, full_image.GetPixel(region.y + y, region.x + x));
+        }
+    }
     Compare(image, ok_image);
 }
 
+// Assembles every plane of the image from the rows passed to a RowSink,
+// checking that they come in order.
+class RowAssembler {
+public:
+    RowAssembler(const ImageHeader& header, const DecoderOptions& options)
+        : width_((header.width + options.scale - 1) / options.scale),
+          height_((header.height + options.scale - 1) / options.scale),
+          format_(options.format),
+          planes_(Image::PlaneCount(options.format)),
+          sizes_(planes_.size()) {
+    }
+
+    RowSink Sink() {
+        return [this](const Image& rows, size_t y) { Add(rows, y); };
+    }
+
+    Image Finish() {
+        REQUIRE(next_row_ == height_);
+        Image image;
+        image.SetSize(sizes_, format_);
+        for (size_t plane = 0; plane < planes_.size(); ++plane) {
+            size_t bytes = sizes_[plane].width * Image::BytesPerPixel(format_);
+            for (size_t i = 0; i < sizes_[plane].height; ++i) {
+                std::copy_n(planes_[plane].data() + i * bytes, bytes, image.Row(i, plane));
+            }
+        }
+        return image;
+    }
+
+private:
+    void Add(const Image& rows, size_t y) {
+        REQUIRE(y == next_row_);
+        REQUIRE(rows.Width() == width_);
+        REQUIRE(y + rows.Height() <= height_);
+        for (size_t plane = 0; plane < planes_.size(); ++plane) {
+            size_t bytes = rows.Width(plane) * Image::BytesPerPixel(rows.Format());
+            size_t rows_cnt = sizes_[plane].height + rows.Height(plane);
+            sizes_[plane] = rows.GetPlaneSize(plane);
+            sizes_[plane].height = rows_cnt;
+            for (size_t i = 0; i < rows.Height(plane); ++i) {
+                planes_[plane].insert(planes_[plane].end(), rows.Row(i, plane),
+                                      rows.Row(i, plane) + bytes);
+            }
+        }
+        next_row_ = y + rows.Height();
+    }
+
+    size_t width_;
+    size_t height_;
+    PixelFormat format_;
+    std::vector<std::vector<uint8_t>> planes_;
+    std::vector<PlaneSize> sizes_;
+    size_t next_row_ = 0;
+};
+
+void CheckPushed(const std::string& filename, size_t chunk_size,
+                 const std::string& expected_comment) {
+    std::cerr << "Running " << filename << " in chunks of " << chunk_size << "\n";
+    auto data = ReadFile(kBasePath + "tests/" + filename);
+    auto feed = [&](PushDecoder& decoder) {
+        for (size_t i = 0; i < data.size(); i += chunk_size) {
+            decoder.Feed(std::span<const uint8_t>(data).subspan(
+                i, std::min(chunk_size, data.size() - i)));
+        }
+    };
+    PushDecoder decoder;
+    feed(decoder);
+    CheckDecoded(filename, decoder.Finish(), 1, expected_comment, std::nullopt);
+
+    std::cerr << "Running " << filename << " in chunks of " << chunk_size << " by rows\n";
+    RowAssembler assembler(ProbeHeader(std::span<const uint8_t>(data)), {});
+    PushDecoder rows_decoder(assembler.Sink());
+    feed(rows_decoder);
+    auto comment = rows_decoder.Finish().GetComment();
+    auto image = assembler.Finish();
+    image.SetComment(comment);
+    CheckDecoded(filename, image, 1, expected_comment, std::nullopt);
+}
+
+void CheckBatch(const std::vector<TestFile>& files, const DecoderOptions& options) {
+    std::cerr << "Running a batch of " << files.size() << "\n";
+    std::vector<std::vector<uint8_t>> data;
+    std::vector<std::span<const uint8_t>> inputs;
+    for (const auto& file : files) {
+        data.push_back(ReadFile(kBasePath + "tests/" + file.filename));
+    }
+    for (const auto& bytes : data) {
+        inputs.emplace_back(bytes);
+    }
+    auto items = DecodeBatch(inputs, options);
+    REQUIRE(items.size() == files.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (files[i].filename.starts_with("bad/")) {
+            REQUIRE(items[i].error);
+        } else {
+            REQUIRE_FALSE(items[i].error);
+            CheckDecoded(files[i].filename, items[i].image, options.scale, files[i].comment,
+                         std::nullopt);
+        }
+    }
+}
+
+void CheckContext(const std::vector<TestFile>& files, const DecoderOptions& options) {
+    DecoderContext context(options);
+    for (const auto& file : files) {
+        std::cerr << "Running " << file.filename << " in a shared context\n";
+        auto data = ReadFile(kBasePath + "tests/" + file.filename);
+        if (file.filename.starts_with("bad/")) {
+            CHECK_THROWS(context.Decode(std::span<const uint8_t>(data)));
+            continue;
+        }
+        auto image = context.Decode(std::span<const uint8_t>(data));
+        CheckDecoded(file.filename, image, options.scale, file.comment, std::nullopt);
+    }
+}
+
+void CheckRows(const std::string& filename, const DecoderOptions& options,
+               const std::string& expected_comment) {
+    std::cerr << "Running " << filename << " by rows\n";
+    auto data = ReadFile(kBasePath + "tests/" + filename);
+    auto probed = ProbeHeader(std::span<const uint8_t>(data));
+    RowAssembler assembler(probed, options);
+    auto header = DecodeRows(std::span<const uint8_t>(data), assembler.Sink(), options);
+    auto image = assembler.Finish();
+    image.SetComment(header.comment);
+    CheckDecoded(filename, image, options.scale, expected_comment, std::nullopt);
+}
+
+void CheckPlanes(const std::string& filename, const Region& region,
+                 const DecoderOptions& options) {
+    std::cerr << "Running " << filename << " subsampled planes\n";
+    auto data = ReadFile(kBasePath + "tests/" + filename);
+    auto header = ProbeHeader(std::span<const uint8_t>(data));
+    DecoderOptions planar_options = options;
+    planar_options.format = PixelFormat::kYCbCrPlanar;
+    planar_options.upsampling = Upsampling::kBox;
+    auto planar = DecodeRegion(std::span<const uint8_t>(data), region, planar_options);
+    DecoderOptions subsampled_options = options;
+    subsampled_options.format = PixelFormat::kYCbCrSubsampled;
+    auto image = DecodeRegion(std::span<const uint8_t>(data), region, subsampled_options);
+    REQUIRE(image.Width() == planar.Width());
+    REQUIRE(image.Height() == planar.Height());
+    size_t h_max = 0;
+    size_t v_max = 0;
+    for (const auto& component : header.components) {
+        h_max = std::max(h_max, component.h_sampling);
+        v_max = std::max(v_max, component.v_sampling);
+    }
+    for (size_t plane = 0; plane < header.components.size(); ++plane) {
+        size_t h = header.components[plane].h_sampling;
+        size_t v = header.components[plane].v_sampling;
+        size_t x0 = region.x * h / h_max;
+        size_t y0 = region.y * v / v_max;
+        REQUIRE(image.Width(plane) == ((region.x + planar.Width()) * h + h_max - 1) / h_max - x0);
+        REQUIRE(image.Height(plane) ==
+                ((region.y + planar.Height()) * v + v_max - 1) / v_max - y0);
+        // Box upsampling replicates the sample under every pixel.
+        for (size_t y = 0; y < planar.Height(); ++y) {
+            const uint8_t* row = image.Row((region.y + y) * v / v_max - y0, plane);
+            for (size_t x = 0; x < planar.Width(); ++x) {
+                REQUIRE(planar.Row(y, plane)[x] == row[(region.x + x) * h / h_max - x0]);
+            }
+        }
+    }
+    // Pixels take their chroma from the same samples, wherever the region starts.
+    for (size_t y = 0; y < planar.Height(); ++y) {
+        for (size_t x = 0; x < planar.Width(); ++x) {
+            REQUIRE(Distance(image.GetPixel(y, x), planar.GetPixel(y, x)) == 0);
+        }
+    }
+}
+
+void CheckHeader(const std::string& filename, const std::string& expected_comment) {
+    std::cerr << "Probing " << filename << "\n";
+    auto data = ReadFile(kBasePath + "tests/" + filename);
+    size_t sos = 0;
+    while (sos + 1 < data.size() && !(data[sos] == 0xFF && data[sos + 1] == 0xDA)) {
+        ++sos;
+    }
+    REQUIRE(sos + 1 < data.size());
+    auto header = ProbeHeader(std::span<const uint8_t>(data.data(), sos + 2));
+    auto ok_image = ReadJpg(kBasePath + "tests/" + filename);
+    REQUIRE(header.width == ok_image.Width());
+    REQUIRE(header.height == ok_image.Height());
+    REQUIRE(header.comment == expected_comment);
+    REQUIRE((header.components.size() == 1 || header.components.size() == 3));
+    for (const auto& component : header.components) {
+        REQUIRE((1 <= component.h_sampling && component.h_sampling <= 4));
+        REQUIRE((1 <= component.v_sampling && component.v_sampling <= 4));
+    }
+}
+
 void ExpectFail(const std::string& filename) {
     std::cerr << "Running negative test " << filename << "\n";
     std::ifstream fin(kBasePath + "tests/bad/" + filename);
@@ -86,4 +330,6 @@ void ExpectFail(const std::string& filename) {
         throw std::invalid_argument("Cannot open a file");
     }
     CHECK_THROWS(Decode(fin));
+    auto data = ReadFile(kBasePath + "tests/bad/" + filename);
+    CHECK_THROWS(Decode(std::span<const uint8_t>(data)));
 }
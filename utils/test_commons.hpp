@@ -2,8 +2,55 @@
 
 #include <string>
 #include <optional>
+#include <vector>
+
+#include <decoder.h>
 
 void CheckImage(const std::string& filename, const std::string& expected_comment = "",
                 std::optional<std::string> output_filename = std::nullopt);
 
+void CheckImage(const std::string& filename, const DecoderOptions& options,
+                const std::string& expected_comment = "",
+                std::optional<std::string> output_filename = std::nullopt);
+
+// Same checks, decoding from a buffer in memory and from a mapped file.
+void CheckImageFromMemory(const std::string& filename, const std::string& expected_comment = "");
+void CheckMappedImage(const std::string& filename, const std::string& expected_comment = "");
+
+// Decodes |region| and compares it with the same crop of the libjpeg output.
+void CheckRegion(const std::string& filename, const Region& region,
+                 const DecoderOptions& options = {});
+
+// Feeds the file to a PushDecoder in chunks of |chunk_size| bytes and checks the image,
+// then does the same with a PushDecoder passing the rows to a sink.
+void CheckPushed(const std::string& filename, size_t chunk_size,
+                 const std::string& expected_comment = "");
+
+// A file from tests/ and the comment its image is expected to carry.
+struct TestFile {
+    std::string filename;
+    std::string comment;
+};
+
+// Decodes the files in one batch and checks every image; those in tests/bad/ must fail.
+void CheckBatch(const std::vector<TestFile>& files, const DecoderOptions& options = {});
+
+// Decodes the files one after another through one DecoderContext, checking them as
+// CheckBatch does.
+void CheckContext(const std::vector<TestFile>& files, const DecoderOptions& options = {});
+
+// Decodes the image row by row through DecodeRows and checks the assembled rows.
+void CheckRows(const std::string& filename, const DecoderOptions& options = {},
+               const std::string& expected_comment = "");
+
+// Decodes |region| into kYCbCrSubsampled planes and checks them against the
+// kYCbCrPlanar output with box upsampling. Unscaled only: scaled planar output
+// keeps more chroma resolution.
+void CheckPlanes(const std::string& filename, const Region& region,
+                 const DecoderOptions& options = {});
+
+// Probes the header from the data up to the first SOS marker only and
+// compares it with the image decoded by libjpeg.
+void CheckHeader(const std::string& filename, const std::string& expected_comment = "");
+
 void ExpectFail(const std::string& filename);